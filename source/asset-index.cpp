@@ -0,0 +1,600 @@
+/* asset-index.cpp
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+// Program for finding out which data files use which images.
+// $ g++ --std=c++17 -O2 -pthread -o asset-index asset-index.cpp
+// $ ./asset-index <index> --build [--threads <count>] [--images <directory>] <data>...
+// Scans every data file (any directory stands for all the .txt files under it)
+// on several threads at once, and saves an index of every node that refers to
+// an image: a "sprite", "landscape", "thumbnail", "icon" and so on. If an images
+// directory is given, every image in it is listed in the index too, by the name
+// that data files would use for it (with no extension, animation frame number,
+// or "@2x" suffix). The index is a single binary file that is mapped straight
+// into memory to be searched, so the queries below take no time at all:
+// $ ./asset-index <index> --users <image>...
+// Lists the file, line, and place in the data of every use of each image. A
+// name ending in "/" stands for every image in that directory.
+// $ ./asset-index <index> --unused
+// Lists every image that nothing uses.
+// $ ./asset-index <index> --missing
+// Lists every image that is used, but is not in the images directory. These two
+// only work if the index was built with an images directory.
+
+#include "shared/DataFile.cpp"
+#include "shared/DataNode.cpp"
+#include "shared/ThreadPool.cpp"
+
+#if defined __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// One node that refers to an image.
+class Use {
+public:
+	string image;
+	int line;
+	// The nodes this one is inside of, like: ship "Kestrel" > engine.
+	string path;
+};
+
+// The index, as it is laid out in the file. All the names are sorted, and the
+// uses of each one are next to each other, so a name can be found by a binary
+// search and its uses read straight out of the file.
+class Index {
+public:
+	class Header {
+	public:
+		char magic[4];
+		uint32_t version;
+		uint32_t names;
+		uint32_t uses;
+		uint32_t files;
+		uint32_t stringsSize;
+		// Whether the images that exist were listed, so that it is known which
+		// ones are missing or unused.
+		uint32_t hasImages;
+	};
+	class Name {
+	public:
+		// Where the name is in the strings.
+		uint32_t text;
+		// Its uses are uses[firstUse] to uses[firstUse + useCount - 1].
+		uint32_t firstUse;
+		uint32_t useCount;
+		// How many image files there are for it (for example, one per frame).
+		uint32_t imageCount;
+	};
+	class Entry {
+	public:
+		uint32_t file;
+		uint32_t line;
+		uint32_t path;
+	};
+
+
+public:
+	Index() = default;
+	~Index();
+
+	Index(const Index &) = delete;
+	Index &operator=(const Index &) = delete;
+
+	// Save an index of the given uses of the images in the given files, and of
+	// the images that exist (with how many files each one has), if they were
+	// listed.
+	static bool Save(const string &path, const vector<string> &files, const vector<vector<Use>> &uses,
+		const map<string, int> &images, bool hasImages);
+	// Returns false if the file cannot be read or is not a valid index.
+	bool Load(const string &path);
+
+	// Find the range of names that are equal to the given one or, if it ends
+	// in a slash, that begin with it.
+	pair<const Name *, const Name *> Find(const string &name) const;
+	const Name *begin() const;
+	const Name *end() const;
+	bool HasImages() const;
+
+	const Entry &Uses(const Name &name, int i) const;
+	const char *Text(uint32_t offset) const;
+	const char *File(uint32_t file) const;
+
+
+private:
+	const Header &Info() const;
+
+
+private:
+	const char *data = nullptr;
+	size_t size = 0;
+	bool isMapped = false;
+	// If the file could not be mapped, it is read into this instead.
+	vector<char> buffer;
+
+	const Name *names = nullptr;
+	const Entry *uses = nullptr;
+	const uint32_t *files = nullptr;
+	const char *strings = nullptr;
+};
+
+bool ListFiles(const vector<string> &paths, vector<string> &files);
+void FindUses(const DataNode &node, const string &path, vector<Use> &uses);
+bool ListImages(const string &directory, map<string, int> &images);
+string SpriteName(string path);
+void PrintHelp();
+
+
+
+int main(int, char *argv[])
+{
+	string indexPath;
+	bool build = false;
+	string imagesPath;
+	int threads = ThreadPool::DefaultSize();
+	bool users = false;
+	bool unused = false;
+	bool missing = false;
+	vector<string> args;
+	for(char **it = argv + 1; *it; ++it)
+	{
+		if(!strcmp(*it, "--build"))
+			build = true;
+		else if(!strcmp(*it, "--images") && it[1])
+			imagesPath = *++it;
+		else if(!strcmp(*it, "--threads") && it[1])
+			threads = max(1, atoi(*++it));
+		else if(!strcmp(*it, "--users"))
+			users = true;
+		else if(!strcmp(*it, "--unused"))
+			unused = true;
+		else if(!strcmp(*it, "--missing"))
+			missing = true;
+		else if(!strcmp(*it, "-h") || !strcmp(*it, "--help"))
+		{
+			PrintHelp();
+			return 0;
+		}
+		else if(indexPath.empty())
+			indexPath = *it;
+		else
+			args.push_back(*it);
+	}
+	if(indexPath.empty() || build + users + unused + missing != 1 || ((build || users) && args.empty()))
+	{
+		PrintHelp();
+		return 1;
+	}
+
+	if(build)
+	{
+		vector<string> files;
+		if(!ListFiles(args, files))
+			return 1;
+		vector<vector<Use>> uses(files.size());
+		ThreadPool pool(threads);
+		pool.ForEach(0, files.size(), [&](int first, int last)
+		{
+			for(int i = first; i < last; ++i)
+			{
+				DataFile file(files[i], true);
+				for(const DataNode &node : file)
+					FindUses(node, "", uses[i]);
+			}
+		});
+		map<string, int> images;
+		if(!imagesPath.empty() && !ListImages(imagesPath, images))
+			return 1;
+
+		if(!Index::Save(indexPath, files, uses, images, !imagesPath.empty()))
+		{
+			cerr << "Unable to write: " << indexPath << endl;
+			return 1;
+		}
+		size_t count = 0;
+		for(const vector<Use> &list : uses)
+			count += list.size();
+		cout << "Indexed " << count << " uses of images in " << files.size() << " files";
+		if(!imagesPath.empty())
+			cout << ", and " << images.size() << " images";
+		cout << "." << endl;
+		return 0;
+	}
+
+	Index index;
+	if(!index.Load(indexPath))
+	{
+		cerr << "Not a valid index: " << indexPath << endl;
+		return 1;
+	}
+	if((unused || missing) && !index.HasImages())
+	{
+		cerr << "That index was built without --images, so it does not know which images exist." << endl;
+		return 1;
+	}
+	if(users)
+	{
+		for(const string &name : args)
+		{
+			auto range = index.Find(name);
+			size_t count = 0;
+			for(const Index::Name *it = range.first; it != range.second; ++it)
+				for(uint32_t i = 0; i < it->useCount; ++i, ++count)
+				{
+					const Index::Entry &use = index.Uses(*it, i);
+					cout << index.File(use.file) << ":" << use.line << ": " << index.Text(use.path)
+						<< " uses " << index.Text(it->text) << endl;
+				}
+			if(!count)
+				cout << name << ": not used." << endl;
+		}
+	}
+	else
+		for(const Index::Name &name : index)
+			if(unused ? (name.imageCount && !name.useCount) : (name.useCount && !name.imageCount))
+				cout << index.Text(name.text) << endl;
+	return 0;
+}
+
+
+
+Index::~Index()
+{
+#if defined __linux__
+	if(isMapped)
+		munmap(const_cast<char *>(data), size);
+#endif
+}
+
+
+
+bool Index::Save(const string &path, const vector<string> &files, const vector<vector<Use>> &uses,
+	const map<string, int> &images, bool hasImages)
+{
+	// Store each distinct string only once.
+	string strings;
+	unordered_map<string, uint32_t> offsets;
+	auto add = [&](const string &text) -> uint32_t
+	{
+		auto it = offsets.find(text);
+		if(it != offsets.end())
+			return it->second;
+		uint32_t offset = strings.size();
+		strings.append(text.c_str(), text.size() + 1);
+		offsets[text] = offset;
+		return offset;
+	};
+
+	// Group the uses by the image they are of.
+	map<string, vector<Entry>> byName;
+	for(const auto &it : images)
+		byName[it.first];
+	for(size_t file = 0; file < uses.size(); ++file)
+		for(const Use &use : uses[file])
+			byName[use.image].push_back({static_cast<uint32_t>(file), static_cast<uint32_t>(use.line), add(use.path)});
+
+	vector<Name> names;
+	vector<Entry> entries;
+	for(const auto &it : byName)
+	{
+		auto image = images.find(it.first);
+		names.push_back({add(it.first), static_cast<uint32_t>(entries.size()), static_cast<uint32_t>(it.second.size()),
+			static_cast<uint32_t>(image == images.end() ? 0 : image->second)});
+		entries.insert(entries.end(), it.second.begin(), it.second.end());
+	}
+	vector<uint32_t> fileNames;
+	for(const string &file : files)
+		fileNames.push_back(add(file));
+
+	Header header;
+	memcpy(header.magic, "ESAI", 4);
+	header.version = 2;
+	header.names = names.size();
+	header.uses = entries.size();
+	header.files = fileNames.size();
+	header.stringsSize = strings.size();
+	header.hasImages = hasImages;
+
+	// Write to a temporary file first, so that an index that is being read is
+	// never left half written.
+	const string temporary = path + ".tmp";
+	{
+		ofstream out(temporary, ios::binary);
+		out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char *>(names.data()), names.size() * sizeof(Name));
+		out.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(Entry));
+		out.write(reinterpret_cast<const char *>(fileNames.data()), fileNames.size() * sizeof(uint32_t));
+		out.write(strings.data(), strings.size());
+		if(!out)
+			return false;
+	}
+	error_code error;
+	filesystem::rename(temporary, path, error);
+	return !error;
+}
+
+
+
+bool Index::Load(const string &path)
+{
+#if defined __linux__
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat info;
+	if(!fstat(fd, &info) && info.st_size > 0)
+	{
+		void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(mapped != MAP_FAILED)
+		{
+			data = static_cast<const char *>(mapped);
+			size = info.st_size;
+			isMapped = true;
+		}
+	}
+	close(fd);
+#endif
+	if(!isMapped)
+	{
+		ifstream in(path, ios::binary);
+		if(!in)
+			return false;
+		buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+		data = buffer.data();
+		size = buffer.size();
+	}
+
+	if(size < sizeof(Header))
+		return false;
+	const Header &header = Info();
+	if(memcmp(header.magic, "ESAI", 4) || header.version != 2)
+		return false;
+	const uint64_t expected = sizeof(Header) + static_cast<uint64_t>(header.names) * sizeof(Name)
+		+ static_cast<uint64_t>(header.uses) * sizeof(Entry) + static_cast<uint64_t>(header.files) * sizeof(uint32_t)
+		+ header.stringsSize;
+	if(size != expected || (header.stringsSize && data[size - 1]))
+		return false;
+
+	names = reinterpret_cast<const Name *>(data + sizeof(Header));
+	uses = reinterpret_cast<const Entry *>(names + header.names);
+	files = reinterpret_cast<const uint32_t *>(uses + header.uses);
+	strings = reinterpret_cast<const char *>(files + header.files);
+
+	// Check every offset once, here, so that nothing read from the index later
+	// can point outside of it. The strings end in a null character, so any
+	// offset into them gives a complete string.
+	for(const Name &name : *this)
+		if(name.text >= header.stringsSize
+				|| static_cast<uint64_t>(name.firstUse) + name.useCount > header.uses)
+			return false;
+	for(uint32_t i = 0; i < header.uses; ++i)
+		if(uses[i].file >= header.files || uses[i].path >= header.stringsSize)
+			return false;
+	for(uint32_t i = 0; i < header.files; ++i)
+		if(files[i] >= header.stringsSize)
+			return false;
+	return true;
+}
+
+
+
+pair<const Index::Name *, const Index::Name *> Index::Find(const string &name) const
+{
+	const bool isPrefix = !name.empty() && name.back() == '/';
+	auto less = [this](const Name &a, const string &b) { return strcmp(Text(a.text), b.c_str()) < 0; };
+	const Name *first = lower_bound(begin(), end(), name, less);
+	const Name *last = first;
+	while(last != end() && (isPrefix ? !strncmp(Text(last->text), name.c_str(), name.size())
+			: Text(last->text) == name))
+		++last;
+	return make_pair(first, last);
+}
+
+
+
+const Index::Name *Index::begin() const
+{
+	return names;
+}
+
+
+
+const Index::Name *Index::end() const
+{
+	return names + Info().names;
+}
+
+
+
+bool Index::HasImages() const
+{
+	return Info().hasImages;
+}
+
+
+
+const Index::Entry &Index::Uses(const Name &name, int i) const
+{
+	return uses[name.firstUse + i];
+}
+
+
+
+const char *Index::Text(uint32_t offset) const
+{
+	return strings + offset;
+}
+
+
+
+const char *Index::File(uint32_t file) const
+{
+	return Text(files[file]);
+}
+
+
+
+const Index::Header &Index::Info() const
+{
+	return *reinterpret_cast<const Header *>(data);
+}
+
+
+
+// Get the data files to scan, in a fixed order. Directories are searched for
+// .txt files, all the way down. Returns false if a directory or a file named
+// directly cannot be read.
+bool ListFiles(const vector<string> &paths, vector<string> &files)
+{
+	for(const string &path : paths)
+	{
+		error_code error;
+		if(!filesystem::is_directory(path, error))
+		{
+			// A file that cannot be opened would just look empty when loaded.
+			if(!ifstream(path))
+			{
+				cerr << "Unable to read: " << path << endl;
+				return false;
+			}
+			files.push_back(path);
+			continue;
+		}
+		vector<string> found;
+		for(filesystem::recursive_directory_iterator it(path, error), end; !error && it != end; it.increment(error))
+		{
+			error_code ignored;
+			if(it->is_regular_file(ignored) && it->path().extension() == ".txt")
+				found.push_back(it->path().string());
+		}
+		if(error)
+		{
+			cerr << "Unable to list the files in: " << path << " (" << error.message() << ")" << endl;
+			return false;
+		}
+		sort(found.begin(), found.end());
+		files.insert(files.end(), found.begin(), found.end());
+	}
+	return true;
+}
+
+
+
+// Find every reference to an image in the given node and its children. The
+// path is where the node is, as in: system "Sol" > object "Earth".
+void FindUses(const DataNode &node, const string &path, vector<Use> &uses)
+{
+	static const set<string> KEYS = {
+		"sprite", "landscape", "thumbnail", "icon", "scene", "portrait", "image",
+		"flare sprite", "reverse flare sprite", "steering flare sprite", "hardpoint sprite"
+	};
+	if(node.Size() >= 2 && KEYS.count(node.Token(0)))
+		uses.push_back({node.Token(1), node.LineNumber(), path});
+
+	if(!node.HasChildren())
+		return;
+	string here = node.Token(0);
+	if(node.Size() >= 2)
+		here += " \"" + node.Token(1) + "\"";
+	if(!path.empty())
+		here = path + " > " + here;
+	for(const DataNode &child : node)
+		FindUses(child, here, uses);
+}
+
+
+
+// Find every image in the given directory, and count how many files there are
+// for each name that the data files would use for it. Returns false if the
+// directory cannot be read.
+bool ListImages(const string &directory, map<string, int> &images)
+{
+	error_code error;
+	for(filesystem::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+	{
+		error_code ignored;
+		if(!it->is_regular_file(ignored))
+			continue;
+		string extension = it->path().extension().string();
+		if(extension != ".png" && extension != ".jpg")
+			continue;
+		++images[SpriteName(it->path().lexically_relative(directory).generic_string())];
+	}
+	if(error)
+		cerr << "Unable to list the images in: " << directory << " (" << error.message() << ")" << endl;
+	return !error;
+}
+
+
+
+// Turn the path of an image file into the name data files use for it, by
+// removing the extension, any "@2x" (high DPI) or "@sw" (swizzle mask) suffix,
+// and any animation frame number with the character that says how the frames
+// are blended.
+string SpriteName(string path)
+{
+	size_t dot = path.rfind('.');
+	if(dot != string::npos && path.find('/', dot) == string::npos)
+		path.erase(dot);
+	for(const char *suffix : {"@2x", "@sw"})
+	{
+		size_t length = strlen(suffix);
+		if(path.size() > length && !path.compare(path.size() - length, length, suffix))
+			path.erase(path.size() - length);
+	}
+	size_t digits = path.size();
+	while(digits && isdigit(static_cast<unsigned char>(path[digits - 1])))
+		--digits;
+	if(digits < path.size() && digits && strchr("+~-^=", path[digits - 1]))
+		path.erase(digits - 1);
+	return path;
+}
+
+
+
+void PrintHelp()
+{
+	cerr << endl;
+	cerr << "Usage: $ asset-index <index> --build [--images <directory>] <data>..." << endl;
+	cerr << "   Saves an index of every use of an image in the given data files, or in all" << endl;
+	cerr << "   the .txt files in the given directories, and of every image in the images" << endl;
+	cerr << "   directory." << endl;
+	cerr << "   --threads: how many threads to scan the files with (default: one per core)." << endl;
+	cerr << "Or: $ asset-index <index> --users <image>..." << endl;
+	cerr << "   Lists where each image is used. A name ending in / means every image in that" << endl;
+	cerr << "   directory." << endl;
+	cerr << "Or: $ asset-index <index> --unused" << endl;
+	cerr << "   Lists every image that is not used." << endl;
+	cerr << "Or: $ asset-index <index> --missing" << endl;
+	cerr << "   Lists every image that is used but is not in the images directory." << endl;
+	cerr << "   These two need an index that was built with --images." << endl;
+	cerr << endl;
+}
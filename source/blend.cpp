@@ -13,193 +13,684 @@ You should have received a copy of the GNU General Public License along with
 this program. If not, see <https://www.gnu.org/licenses/>.
 */
 
-// g++ --std=c++0x blend.cpp -o blend -lpng
-
-#include <png.h>
-#include <zlib.h>
+// Program for combining an opaque image and an additive image into one.
+// $ g++ --std=c++17 -O2 -pthread -o blend blend.cpp -lpng -lz
+// $ ./blend <opaque image> <additive image> <result image>
+// Each color channel of the result is the sum of the two images' channels, each
+// multiplied by its image's alpha. The result has the opaque image's alpha. On
+// x86 processors, the pixels are blended with SSE2 or AVX2 instructions,
+// depending on what the processor supports.
+// $ ./blend --check [<opaque image> <additive image>]
+// Blends the given images (or two test images covering every combination of
+// alpha and color) with each way of blending that this processor supports,
+// and checks that every pixel matches the plain C++ version exactly.
+// $ ./blend --benchmark [<opaque image> <additive image>]
+// Times each way of blending the given images (or two 4096 x 4096 test images).
+// $ ./blend [--threads <count>] --batch <opaque dir> <additive dir> <result dir>
+// $ ./blend [--threads <count>] --manifest <file>
+// Blends many images at once: every image in the opaque directory (or any of
+// its subdirectories) that has a match with the same name in the additive
+// directory, or every line of the manifest, which lists the opaque, additive,
+// and result image in that order. Some threads read images, one blends them,
+// and the rest write the results, with a limit on how many images can be
+// waiting between one step and the next, so that memory use stays bounded.
+
+#include "shared/DataFile.cpp"
+#include "shared/DataNode.cpp"
+#include "shared/Image.cpp"
+#include "shared/ThreadPool.cpp"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
 #include <vector>
 
+// SSE2 is always there on x86-64, but AVX2 has to be checked for at run time,
+// so its code is compiled separately with the "target" attribute.
+#if defined __SSE2__ && defined __GNUC__
+#include <immintrin.h>
+#define BLEND_SIMD
+#endif
+
 using namespace std;
 
-uint32_t *Read(const char *path, int *width, int *height);
-void Write(const char *path, uint32_t *buffer, int width, int height);
 
 
+// One way of blending a row of pixels: the additive pixels are blended into the
+// opaque pixels in place.
+class Kernel {
+public:
+	const char *name;
+	void (*Blend)(uint32_t *opaque, const uint32_t *additive, size_t count);
+};
+
+
+
+// The images to read, and where to write the result, for one image in a batch.
+class Job {
+public:
+	string opaque;
+	string additive;
+	string result;
+};
+
+
+
+// A pair of images on their way through the batch pipeline.
+class Frame {
+public:
+	size_t job;
+	Image opaque;
+	Image additive;
+};
+
+
+
+// A queue for passing items from one set of threads to another. Adding an item
+// waits if the queue is full, so a fast step cannot get too far ahead of a slow
+// one, and taking an item waits until one is available.
+template <class Type>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(size_t capacity);
+
+	void Push(Type item);
+	// Get the next item. This returns false once the queue is closed and empty.
+	bool Pop(Type &item);
+	// Mark that no more items will be added.
+	void Close();
+
+
+private:
+	size_t capacity;
+	queue<Type> items;
+	mutex lock;
+	condition_variable notFull;
+	condition_variable notEmpty;
+	bool closed = false;
+};
+
+
+
+uint32_t BlendPixel(uint32_t opaque, uint32_t additive);
+void BlendScalar(uint32_t *opaque, const uint32_t *additive, size_t count);
+#ifdef BLEND_SIMD
+void BlendSSE2(uint32_t *opaque, const uint32_t *additive, size_t count);
+void BlendAVX2(uint32_t *opaque, const uint32_t *additive, size_t count);
+#endif
+vector<Kernel> Kernels();
+string ReadImages(const string &opaquePath, const string &additivePath, Image &opaque, Image &additive);
+bool ListJobs(const string &opaqueDirectory, const string &additiveDirectory, const string &resultDirectory,
+	vector<Job> &jobs, int &skipped);
+bool ReadManifest(const string &path, vector<Job> &jobs, int &skipped);
+bool RunBatch(const vector<Job> &jobs, int skipped, int threads);
+void MakeTestImages(Image &opaque, Image &additive);
+bool Check(const Image &opaque, const Image &additive);
+void Benchmark(const Image &opaque, const Image &additive);
+void PrintHelp();
 
-int main(int argc, char *argv[])
+
+
+int main(int, char *argv[])
 {
-	if(argc != 4)
+	bool check = false;
+	bool benchmark = false;
+	bool batch = false;
+	const char *manifestPath = nullptr;
+	int threads = ThreadPool::DefaultSize();
+	vector<string> paths;
+	for(char **it = argv + 1; *it; ++it)
 	{
-		cout << "Usage: $ blend <opaque image> <additive image> <result image>" << endl;
-		return 1;
+		if(!strcmp(*it, "--check"))
+			check = true;
+		else if(!strcmp(*it, "--benchmark"))
+			benchmark = true;
+		else if(!strcmp(*it, "--batch"))
+			batch = true;
+		else if(!strcmp(*it, "--manifest") && it[1])
+			manifestPath = *++it;
+		else if(!strcmp(*it, "--threads") && it[1])
+			threads = max(1, atoi(*++it));
+		else if(**it == '-' && (*it)[1])
+		{
+			PrintHelp();
+			return 1;
+		}
+		else
+			paths.push_back(*it);
 	}
 
-	int ow = 0, oh = 0;
-	uint32_t *op = Read(argv[1], &ow, &oh);
-	if(!op)
+	if(check || benchmark)
 	{
-		cerr << "Unable to read image: " << argv[1] << endl;
-		return 1;
+		if(!paths.empty() && paths.size() != 2)
+		{
+			PrintHelp();
+			return 1;
+		}
+		Image opaque;
+		Image additive;
+		if(paths.empty())
+			MakeTestImages(opaque, additive);
+		else
+		{
+			const string error = ReadImages(paths[0], paths[1], opaque, additive);
+			if(!error.empty())
+			{
+				cerr << error << endl;
+				return 1;
+			}
+		}
+
+		if(check && !Check(opaque, additive))
+			return 1;
+		if(benchmark)
+			Benchmark(opaque, additive);
+		return 0;
 	}
 
-	int aw = 0, ah = 0;
-	uint32_t *ap = Read(argv[2], &aw, &ah);
-	if(!op)
+	if(manifestPath || batch)
 	{
-		cerr << "Unable to read image: " << argv[2] << endl;
-		delete [] op;
+		if(manifestPath ? !paths.empty() : paths.size() != 3)
+		{
+			PrintHelp();
+			return 1;
+		}
+		vector<Job> jobs;
+		int skipped = 0;
+		if(manifestPath ? !ReadManifest(manifestPath, jobs, skipped)
+				: !ListJobs(paths[0], paths[1], paths[2], jobs, skipped))
+			return 1;
+		if(jobs.empty() && !skipped)
+		{
+			cerr << "There are no images to blend." << endl;
+			return 1;
+		}
+		return !RunBatch(jobs, skipped, threads);
+	}
+
+	if(paths.size() != 3)
+	{
+		PrintHelp();
 		return 1;
 	}
 
-	if(ow != aw || oh != ah)
+	Image opaque;
+	Image additive;
+	const string error = ReadImages(paths[0], paths[1], opaque, additive);
+	if(!error.empty())
 	{
-		cerr << "Images are different sizes: " << ow << "x" << oh << " versus "
-			<< aw << "x" << ah << "." << endl;
-		delete [] op;
-		delete [] ap;
+		cerr << error << endl;
 		return 1;
 	}
 
-	for(int y = 0; y < oh; ++y)
+	// The pixels of an image are stored in one block, so they can all be
+	// blended at once.
+	Kernels().front().Blend(opaque.Pixels(), additive.Pixels(),
+		static_cast<size_t>(opaque.Width()) * opaque.Height());
+
+	if(!opaque.Write(paths[2]))
 	{
-		uint32_t *oit = op + y * ow;
-		uint32_t *ait = ap + y * aw;
+		cerr << "Unable to write image: " << paths[2] << endl;
+		return 1;
+	}
 
-		for(uint32_t *oend = oit + ow; oit != oend; ++oit, ++ait)
-		{
-			uint64_t oA = (*oit >> 24) & 0xFF;
-			uint64_t oR = (*oit >> 16) & 0xFF;
-			uint64_t oG = (*oit >> 8) & 0xFF;
-			uint64_t oB = (*oit >> 0) & 0xFF;
+	return 0;
+}
 
-			uint64_t aA = (*ait >> 24) & 0xFF;
-			uint64_t aR = (*ait >> 16) & 0xFF;
-			uint64_t aG = (*ait >> 8) & 0xFF;
-			uint64_t aB = (*ait >> 0) & 0xFF;
 
-			oR = min(uint64_t(255), (oR * oA) / 255 + (aR * aA) / 255);
-			oG = min(uint64_t(255), (oG * oA) / 255 + (aG * aA) / 255);
-			oB = min(uint64_t(255), (oB * oA) / 255 + (aB * aA) / 255);
 
-			*oit = static_cast<uint32_t>((oA << 24) + (oR << 16) + (oG << 8) + (oB << 0));
-		}
-	}
+template <class Type>
+BoundedQueue<Type>::BoundedQueue(size_t capacity)
+	: capacity(max<size_t>(capacity, 1))
+{
+}
 
-	Write(argv[3], op, ow, oh);
 
-	return 0;
+
+template <class Type>
+void BoundedQueue<Type>::Push(Type item)
+{
+	unique_lock<mutex> guard(lock);
+	notFull.wait(guard, [this]() { return items.size() < capacity; });
+	items.push(move(item));
+	notEmpty.notify_one();
 }
 
 
 
-uint32_t *Read(const char *path, int *width, int *height)
+template <class Type>
+bool BoundedQueue<Type>::Pop(Type &item)
 {
-	FILE *file = fopen(path, "rb");
-	if(!file)
-		return nullptr;
+	unique_lock<mutex> guard(lock);
+	notEmpty.wait(guard, [this]() { return !items.empty() || closed; });
+	if(items.empty())
+		return false;
+	item = move(items.front());
+	items.pop();
+	notFull.notify_one();
+	return true;
+}
+
+
+
+template <class Type>
+void BoundedQueue<Type>::Close()
+{
+	lock_guard<mutex> guard(lock);
+	closed = true;
+	notEmpty.notify_all();
+}
+
+
+
+// This is how blending has always been done, and the vectorized versions must
+// give exactly the same result.
+uint32_t BlendPixel(uint32_t opaque, uint32_t additive)
+{
+	uint64_t oA = (opaque >> 24) & 0xFF;
+	uint64_t oR = (opaque >> 16) & 0xFF;
+	uint64_t oG = (opaque >> 8) & 0xFF;
+	uint64_t oB = (opaque >> 0) & 0xFF;
+
+	uint64_t aA = (additive >> 24) & 0xFF;
+	uint64_t aR = (additive >> 16) & 0xFF;
+	uint64_t aG = (additive >> 8) & 0xFF;
+	uint64_t aB = (additive >> 0) & 0xFF;
+
+	oR = min(uint64_t(255), (oR * oA) / 255 + (aR * aA) / 255);
+	oG = min(uint64_t(255), (oG * oA) / 255 + (aG * aA) / 255);
+	oB = min(uint64_t(255), (oB * oA) / 255 + (aB * aA) / 255);
+
+	return static_cast<uint32_t>((oA << 24) + (oR << 16) + (oG << 8) + (oB << 0));
+}
+
+
+
+void BlendScalar(uint32_t *opaque, const uint32_t *additive, size_t count)
+{
+	for(uint32_t *end = opaque + count; opaque != end; ++opaque, ++additive)
+		*opaque = BlendPixel(*opaque, *additive);
+}
 
-	// Set up libpng.
-	png_struct *png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-	if(!png)
-		return nullptr;
 
-	png_info *info = png_create_info_struct(png);
-	if(!info)
+
+#ifdef BLEND_SIMD
+// The vector code works on 16-bit lanes, each holding one channel of a pixel.
+// For any 16-bit x, x / 255 is exactly (x * 0x8081) >> 23, and the high half of
+// that product is one instruction. A channel times its alpha is at most 65025,
+// so that trick gives the same quotient as the division above. The sum of two
+// quotients is at most 510, and packing the lanes back into bytes clamps it to
+// 255 just like min() does. Blending the alpha channel gives nonsense, so it is
+// replaced by the opaque image's alpha afterwards.
+namespace {
+	inline __m128i Premultiply(__m128i channels)
 	{
-		png_destroy_read_struct(&png, nullptr, nullptr);
-		return nullptr;
+		const __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(channels, 0xFF), 0xFF);
+		const __m128i product = _mm_mullo_epi16(channels, alpha);
+		return _mm_srli_epi16(_mm_mulhi_epu16(product, _mm_set1_epi16(static_cast<short>(0x8081))), 7);
 	}
 
-	uint32_t *buffer = nullptr;
-	if(setjmp(png_jmpbuf(png)))
+	__attribute__((target("avx2")))
+	inline __m256i Premultiply(__m256i channels)
 	{
-		png_destroy_read_struct(&png, &info, nullptr);
-		delete buffer;
-		return nullptr;
+		const __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(channels, 0xFF), 0xFF);
+		const __m256i product = _mm256_mullo_epi16(channels, alpha);
+		return _mm256_srli_epi16(_mm256_mulhi_epu16(product, _mm256_set1_epi16(static_cast<short>(0x8081))), 7);
 	}
+}
 
-	png_init_io(png, file);
-	png_set_sig_bytes(png, 0);
 
-	png_read_info(png, info);
-	*width = png_get_image_width(png, info);
-	*height = png_get_image_height(png, info);
-	if(!*width || !*height)
-		return nullptr;
 
-	// Adjust settings to make sure the result will be a BGRA file.
-	int colorType = png_get_color_type(png, info);
-	int bitDepth = png_get_bit_depth(png, info);
+void BlendSSE2(uint32_t *opaque, const uint32_t *additive, size_t count)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000));
+	size_t i = 0;
+	for( ; i + 4 <= count; i += 4)
+	{
+		__m128i *out = reinterpret_cast<__m128i *>(opaque + i);
+		const __m128i o = _mm_loadu_si128(out);
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(additive + i));
+
+		const __m128i low = _mm_add_epi16(
+			Premultiply(_mm_unpacklo_epi8(o, zero)), Premultiply(_mm_unpacklo_epi8(a, zero)));
+		const __m128i high = _mm_add_epi16(
+			Premultiply(_mm_unpackhi_epi8(o, zero)), Premultiply(_mm_unpackhi_epi8(a, zero)));
+		const __m128i sum = _mm_packus_epi16(low, high);
+		_mm_storeu_si128(out, _mm_or_si128(_mm_and_si128(o, alphaMask), _mm_andnot_si128(alphaMask, sum)));
+	}
+	BlendScalar(opaque + i, additive + i, count - i);
+}
 
-	png_set_strip_16(png);
-	png_set_packing(png);
-	if(colorType == PNG_COLOR_TYPE_PALETTE)
-		png_set_palette_to_rgb(png);
-	if(colorType == PNG_COLOR_TYPE_GRAY && bitDepth < 8)
-		png_set_expand_gray_1_2_4_to_8(png);
-	if(colorType & PNG_COLOR_MASK_COLOR)
-		png_set_bgr(png);
-	png_read_update_info(png, info);
 
-	// Read the file.
-	buffer = new uint32_t[*width * *height];
-	vector<png_byte *> rows;
-	for(int y = 0; y < *height; ++y)
-		rows.push_back(reinterpret_cast<png_byte *>(buffer + y * *width));
 
-	png_read_image(png, &rows.front());
+__attribute__((target("avx2")))
+void BlendAVX2(uint32_t *opaque, const uint32_t *additive, size_t count)
+{
+	// Unpacking and packing both work within each 128-bit half, so the pixels
+	// come back out in the same order they went in.
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+	size_t i = 0;
+	for( ; i + 8 <= count; i += 8)
+	{
+		__m256i *out = reinterpret_cast<__m256i *>(opaque + i);
+		const __m256i o = _mm256_loadu_si256(out);
+		const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(additive + i));
+
+		const __m256i low = _mm256_add_epi16(
+			Premultiply(_mm256_unpacklo_epi8(o, zero)), Premultiply(_mm256_unpacklo_epi8(a, zero)));
+		const __m256i high = _mm256_add_epi16(
+			Premultiply(_mm256_unpackhi_epi8(o, zero)), Premultiply(_mm256_unpackhi_epi8(a, zero)));
+		const __m256i sum = _mm256_packus_epi16(low, high);
+		_mm256_storeu_si256(out, _mm256_blendv_epi8(sum, o, alphaMask));
+	}
+	BlendSSE2(opaque + i, additive + i, count - i);
+}
+#endif
+
 
-	// Clean up.
-	png_destroy_read_struct(&png, &info, nullptr);
-	fclose(file);
 
-	return buffer;
+// Get every kernel that this processor can run, fastest first. The last one is
+// always the plain C++ version.
+vector<Kernel> Kernels()
+{
+	vector<Kernel> kernels;
+#ifdef BLEND_SIMD
+	if(__builtin_cpu_supports("avx2"))
+		kernels.push_back({"AVX2", BlendAVX2});
+	kernels.push_back({"SSE2", BlendSSE2});
+#endif
+	kernels.push_back({"scalar", BlendScalar});
+	return kernels;
 }
 
 
 
-void Write(const char *path, uint32_t *buffer, int width, int height)
+// Read a pair of images to be blended. If they cannot be read or do not match,
+// this returns a description of the problem.
+string ReadImages(const string &opaquePath, const string &additivePath, Image &opaque, Image &additive)
 {
-	// Set up libpng.
-	png_struct *png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
-	if(!png)
-		return;
+	if(!opaque.Read(opaquePath))
+		return "Unable to read image: " + opaquePath;
+	if(!additive.Read(additivePath))
+		return "Unable to read image: " + additivePath;
+	if(opaque.Width() != additive.Width() || opaque.Height() != additive.Height())
+		return "Images are different sizes: " + to_string(opaque.Width()) + "x" + to_string(opaque.Height())
+			+ " versus " + to_string(additive.Width()) + "x" + to_string(additive.Height()) + ".";
+	return string();
+}
 
-	png_info *info = png_create_info_struct(png);
-	if(!info)
+
+
+// Pair up every PNG image in the opaque directory with the image of the same
+// name in the additive directory, and save the result under that name in the
+// result directory. Subdirectories are included. Any image with no match is
+// counted as skipped. Returns false if the directory cannot be read.
+bool ListJobs(const string &opaqueDirectory, const string &additiveDirectory, const string &resultDirectory,
+	vector<Job> &jobs, int &skipped)
+{
+	error_code error;
+	for(filesystem::recursive_directory_iterator it(opaqueDirectory, error), end; !error && it != end; it.increment(error))
+	{
+		error_code ignored;
+		if(!it->is_regular_file(ignored) || it->path().extension() != ".png")
+			continue;
+		const filesystem::path name = it->path().lexically_relative(opaqueDirectory);
+		const filesystem::path additive = filesystem::path(additiveDirectory) / name;
+		if(!filesystem::is_regular_file(additive, ignored))
+		{
+			cerr << "No additive image for: " << it->path().string() << endl;
+			++skipped;
+			continue;
+		}
+		jobs.push_back({it->path().string(), additive.string(), (filesystem::path(resultDirectory) / name).string()});
+	}
+	if(error)
 	{
-		png_destroy_read_struct(&png, nullptr, nullptr);
-		return;
+		cerr << "Unable to list the images in: " << opaqueDirectory << " (" << error.message() << ")" << endl;
+		return false;
 	}
+	sort(jobs.begin(), jobs.end(), [](const Job &a, const Job &b) { return a.opaque < b.opaque; });
+	return true;
+}
+
 
-	if(setjmp(png_jmpbuf(png)))
+
+// Each line of a manifest names an opaque image, an additive image, and the
+// file to save the result in. Paths with spaces in them must be quoted. Any
+// other line is counted as skipped. Returns false if the file cannot be read.
+bool ReadManifest(const string &path, vector<Job> &jobs, int &skipped)
+{
+	ifstream in(path);
+	if(!in)
 	{
-		png_destroy_read_struct(&png, &info, nullptr);
-		return;
+		cerr << "Unable to read the manifest: " << path << endl;
+		return false;
 	}
+	const DataFile file(in);
+	for(const DataNode &node : file)
+	{
+		if(node.Size() == 3)
+			jobs.push_back({node.Token(0), node.Token(1), node.Token(2)});
+		else
+		{
+			node.PrintTrace("Skipping manifest line that is not three paths:");
+			++skipped;
+		}
+	}
+	return true;
+}
 
-	FILE *file = fopen(path, "wb");
-	png_init_io(png, file);
-	png_set_compression_level(png, Z_BEST_COMPRESSION);
 
-	png_set_IHDR(png, info, width, height, 8,
-		PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
-		PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
-	png_set_bgr(png);
-	png_write_info(png, info);
+// Blend every job, passing the images from the threads that read them to one
+// thread that blends them and then on to the threads that write them. Blending
+// is so much faster than reading or writing a PNG that it never needs more than
+// one thread. Writing an image at full compression takes about ten times as
+// long as reading two, so there is a writer for every core and a quarter as
+// many readers. A thread that is waiting on a full or empty queue is asleep, so
+// having more threads than cores costs nothing. Returns false if any of the
+// jobs failed, or if any were skipped before the batch began.
+bool RunBatch(const vector<Job> &jobs, int skipped, int threads)
+{
+	for(const Job &job : jobs)
+	{
+		const filesystem::path directory = filesystem::path(job.result).parent_path();
+		error_code error;
+		if(!directory.empty())
+			filesystem::create_directories(directory, error);
+	}
 
-	vector<png_byte *> rows;
-	for(int y = 0; y < height; ++y)
-		rows.push_back(reinterpret_cast<png_byte *>(buffer + y * width));
+	const int readers = max(1, threads / 4);
+	const int writers = threads;
+	BoundedQueue<Frame> decoded(readers);
+	BoundedQueue<Frame> blended(writers);
 
-	png_write_image(png, &rows.front());
-	png_write_end(png, NULL);
+	// The threads share one place to report problems, so that their messages
+	// are not mixed together.
+	mutex errorMutex;
+	int failed = skipped;
+	auto Fail = [&errorMutex, &failed](const string &message)
+	{
+		lock_guard<mutex> lock(errorMutex);
+		cerr << message << endl;
+		++failed;
+	};
+
+	const auto start = chrono::steady_clock::now();
+	atomic<size_t> next(0);
+	vector<thread> readThreads;
+	for(int i = 0; i < readers; ++i)
+		readThreads.emplace_back([&jobs, &next, &decoded, &Fail]()
+		{
+			for(size_t i = next++; i < jobs.size(); i = next++)
+			{
+				Frame frame;
+				frame.job = i;
+				const string error = ReadImages(jobs[i].opaque, jobs[i].additive, frame.opaque, frame.additive);
+				if(!error.empty())
+					Fail(error);
+				else
+					decoded.Push(move(frame));
+			}
+		});
+
+	thread blendThread([&decoded, &blended]()
+	{
+		const Kernel kernel = Kernels().front();
+		Frame frame;
+		while(decoded.Pop(frame))
+		{
+			kernel.Blend(frame.opaque.Pixels(), frame.additive.Pixels(),
+				static_cast<size_t>(frame.opaque.Width()) * frame.opaque.Height());
+			// The additive image is not needed any more, so free it right away.
+			frame.additive = Image();
+			blended.Push(move(frame));
+		}
+		blended.Close();
+	});
+
+	vector<thread> writeThreads;
+	for(int i = 0; i < writers; ++i)
+		writeThreads.emplace_back([&jobs, &blended, &Fail]()
+		{
+			Frame frame;
+			while(blended.Pop(frame))
+				if(!frame.opaque.Write(jobs[frame.job].result))
+					Fail("Unable to write image: " + jobs[frame.job].result);
+		});
+
+	for(thread &reader : readThreads)
+		reader.join();
+	decoded.Close();
+	blendThread.join();
+	for(thread &writer : writeThreads)
+		writer.join();
+
+	const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	const size_t total = jobs.size() + skipped;
+	cout << "Blended " << total - failed << " of " << total << " images in " << seconds
+		<< " seconds." << endl;
+	return !failed;
+}
+
+
+
+// Make a pair of 4096 x 4096 images in which every alpha value of each image is
+// paired with every value of its red and green channels.
+void MakeTestImages(Image &opaque, Image &additive)
+{
+	const int SIZE = 4096;
+	opaque = Image(SIZE, SIZE);
+	additive = Image(SIZE, SIZE);
+	uint32_t *o = opaque.Pixels();
+	uint32_t *a = additive.Pixels();
+	for(uint32_t i = 0; i < SIZE * SIZE; ++i)
+	{
+		const uint32_t high = i >> 16;
+		const uint32_t middle = (i >> 8) & 0xFF;
+		const uint32_t low = i & 0xFF;
+		o[i] = (high << 24) | (middle << 16) | (low << 8) | (0xFF - low);
+		a[i] = (low << 24) | (high << 16) | (middle << 8) | ((i * 97) & 0xFF);
+	}
+}
+
+
+
+bool Check(const Image &opaque, const Image &additive)
+{
+	const size_t count = static_cast<size_t>(opaque.Width()) * opaque.Height();
+	Image expected = opaque;
+	BlendScalar(expected.Pixels(), additive.Pixels(), count);
 
-	// Clean up.
-	png_destroy_write_struct(&png, &info);
-	fclose(file);
+	bool passed = true;
+	for(const Kernel &kernel : Kernels())
+	{
+		// Blend the first pixel on its own, so the rest start out of alignment
+		// and (usually) end partway through a vector, testing the kernel's
+		// handling of leftover pixels too.
+		Image result = opaque;
+		const size_t first = min<size_t>(count, 1);
+		kernel.Blend(result.Pixels(), additive.Pixels(), first);
+		kernel.Blend(result.Pixels() + first, additive.Pixels() + first, count - first);
+
+		size_t errors = 0;
+		for(size_t i = 0; i < count; ++i)
+			if(result.Pixels()[i] != expected.Pixels()[i])
+			{
+				if(!errors)
+					cerr << kernel.name << ": pixel (" << i % opaque.Width() << ", " << i / opaque.Width()
+						<< ") is " << hex << result.Pixels()[i] << " instead of " << expected.Pixels()[i]
+						<< dec << "." << endl;
+				++errors;
+			}
+		cout << kernel.name << ": " << (errors ? to_string(errors) : "no") << " of " << count
+			<< " pixels differ." << endl;
+		passed &= !errors;
+	}
+	return passed;
+}
+
+
+
+void Benchmark(const Image &opaque, const Image &additive)
+{
+	const size_t count = static_cast<size_t>(opaque.Width()) * opaque.Height();
+	const int REPEAT = 10;
+	double scalarTime = 0.;
+	vector<Kernel> kernels = Kernels();
+	for(auto it = kernels.rbegin(); it != kernels.rend(); ++it)
+	{
+		// Only time the best of several runs, to leave out page faults and
+		// anything else the computer happened to be doing.
+		double best = 0.;
+		for(int i = 0; i < REPEAT; ++i)
+		{
+			Image result = opaque;
+			const auto start = chrono::steady_clock::now();
+			it->Blend(result.Pixels(), additive.Pixels(), count);
+			const double time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			if(!i || time < best)
+				best = time;
+		}
+		if(it == kernels.rbegin())
+			scalarTime = best;
+		cout << it->name << ": " << best * 1000. << " ms (" << count / best * 1e-6 << " megapixels per second, "
+			<< scalarTime / best << " times as fast as scalar)." << endl;
+	}
+}
+
+
+
+void PrintHelp()
+{
+	cerr << endl;
+	cerr << "Usage: $ blend <opaque image> <additive image> <result image>" << endl;
+	cerr << "   Adds the additive image to the opaque image, each weighted by its alpha." << endl;
+	cerr << "Or: $ blend --check [<opaque image> <additive image>]" << endl;
+	cerr << "   Checks that every fast way of blending the given images (or some test images)" << endl;
+	cerr << "   gives exactly the same result as the plain C++ version." << endl;
+	cerr << "Or: $ blend --benchmark [<opaque image> <additive image>]" << endl;
+	cerr << "   Times each way of blending the given images (or two 4096 x 4096 test images)." << endl;
+	cerr << "Or: $ blend [--threads <count>] --batch <opaque dir> <additive dir> <result dir>" << endl;
+	cerr << "   Blends every PNG image in the opaque directory with the image of the same" << endl;
+	cerr << "   name in the additive directory, and saves it under that name in the result" << endl;
+	cerr << "   directory." << endl;
+	cerr << "Or: $ blend [--threads <count>] --manifest <file>" << endl;
+	cerr << "   Blends the images listed in the given file. Each line of it lists an opaque" << endl;
+	cerr << "   image, an additive image, and the result image, in that order." << endl;
+	cerr << "   --threads: how many threads to read and write images with (default: one per" << endl;
+	cerr << "   core)." << endl;
+	cerr << endl;
 }
@@ -14,24 +14,53 @@ this program. If not, see <https://www.gnu.org/licenses/>.
 */
 
 // commerce: program for populating the map with commodity values.
-// $ g++ --std=c++11 -o commerce commerce.cpp
-// $ ./commerce <map> <settings>
-// The settings file should contain key-value pairs:
+// $ g++ --std=c++17 -O2 -pthread -o commerce commerce.cpp
+// $ ./commerce [options] <map> <settings>...
+// Each settings file should contain key-value pairs:
 // name <commodity>
 // base <minimum>
 // bins <weight>...
+// Any settings path that is a directory stands for every .txt file in it. All
+// the commodities are priced from one parse of the map, in parallel, and the
+// result is written as a single file. With --in-place, only the trade lines of
+// the map are rewritten, and everything else in it is left exactly as it was.
+// By default, a constraint solver assigns the bins, and reports it if no valid
+// assignment exists. The --random option uses the original randomized search
+// instead, which never gives up on its own. That search runs on several threads
+// at once, each with its own seed; the first to succeed wins. Either way, the
+// seed that produced the result is printed, and running again with that seed
+// and one thread gives exactly the same result.
+// Each system's price is then smoothed towards those of its neighbors. By
+// default that is a single pass that weighs the system and the average of its
+// neighbors equally; --smooth, --damping and --weight-by-distance tune it.
 
+#include "shared/DataEditor.cpp"
 #include "shared/DataFile.cpp"
 #include "shared/DataNode.cpp"
 #include "shared/DataWriter.cpp"
+#include "shared/GraphSmoother.cpp"
+#include "shared/HopDistance.cpp"
+#include "shared/SystemGraph.cpp"
+#include "shared/ThreadPool.cpp"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
+#include <cstring>
 #include <ctime>
+#include <filesystem>
 #include <fstream>
+#include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
 #include <set>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 using namespace std;
@@ -63,93 +92,458 @@ public:
 	int bin;
 };
 
+class Commodity {
+public:
+	bool Load(const string &path);
+
+	string name;
+	int base = 0;
+	vector<double> binWeight;
+};
+
+class Options {
+public:
+	bool useRandom = false;
+	double seconds = 60.;
+	int threads = 1;
+	int smoothPasses = 1;
+	double damping = .5;
+	bool weightByDistance = false;
+};
+
+// Constraint solver for assigning price bins to systems. Each system's bin must
+// differ by at most one from the bin of each of its neighbors (and so by at most
+// k from any system k jumps away), and no bin may be used more often than its
+// quota allows. Every system's possible bins are tracked as a range, and each
+// choice is propagated outwards until all ranges are consistent with each
+// other. The search backtracks when a choice leads to a dead end, and restarts
+// with new random choices if one search runs into too many of them.
+class BinSolver {
+public:
+	enum Result {SOLVED, INFEASIBLE, TIMED_OUT};
+
+public:
+	BinSolver(const SystemGraph &graph, const vector<int> &quota);
+
+	// Search for an assignment, giving up after the given number of seconds.
+	Result Solve(mt19937 &random, double seconds);
+	// The bin of each system, if a solution was found.
+	const vector<int> &Bins() const;
+	int Restarts() const;
+
+
+private:
+	// A change that can be undone when backtracking.
+	class Change {
+	public:
+		int system;
+		int lo;
+		int hi;
+		bool assigned;
+	};
+
+	// A system whose bin is being chosen, and the bins still left to try.
+	class Choice {
+	public:
+		int system;
+		size_t trail;
+		vector<int> bins;
+		size_t next;
+	};
 
+	// Order systems by how few bins they could be in, then by how many
+	// neighbors they have.
+	typedef tuple<int, int, unsigned, int> Entry;
 
-int main(int argc, char *argv[])
+
+private:
+	void Reset(mt19937 &random);
+	bool Narrow(int system, int lo, int hi);
+	bool Assign(int system, int bin);
+	bool Propagate();
+	bool CheckQuotas() const;
+	void Undo(size_t trailSize);
+	void Enqueue(int system);
+	int Choose();
+	vector<int> OrderBins(int system, mt19937 &random) const;
+	int &Count(int lo, int hi);
+	static int Luby(int i);
+
+
+private:
+	const SystemGraph &graph;
+	const vector<int> quota;
+	const int binCount;
+
+	// The range of bins that each system could still be in, and which bin it
+	// has been assigned, or -1 if none.
+	vector<int> lo;
+	vector<int> hi;
+	vector<int> bin;
+	vector<int> remaining;
+	// How many unassigned systems have each possible range.
+	vector<int> counts;
+
+	vector<Change> trail;
+	vector<int> queue;
+	vector<char> isQueued;
+	priority_queue<Entry, vector<Entry>, greater<Entry>> order;
+	vector<unsigned> tieBreak;
+	int restarts = 0;
+};
+
+bool RandomSearch(const HopDistance &hops, const vector<int> &binQuota, mt19937 &random,
+	const atomic<bool> &stop, vector<Value> &values);
+unsigned PortfolioSearch(const HopDistance &hops, const vector<int> &binQuota, unsigned seed, int threads,
+	mt19937 &random, vector<Value> &values);
+bool Price(const Commodity &commodity, const SystemGraph &graph, const vector<int> &byName,
+	const Options &options, unsigned &seed, vector<int> &prices);
+bool WriteInPlace(DataEditor &editor, const vector<Commodity> &commodities, const SystemGraph &graph,
+	const vector<vector<int>> &prices);
+void PrintHelp();
+
+
+
+int main(int, char *argv[])
 {
-	if(argc < 3)
+	Options options;
+	options.threads = ThreadPool::DefaultSize();
+	unsigned seed = time(NULL);
+	bool inPlace = false;
+	vector<string> paths;
+	for(char **it = argv + 1; *it; ++it)
+	{
+		if(!strcmp(*it, "--random"))
+			options.useRandom = true;
+		else if(!strcmp(*it, "--in-place"))
+			inPlace = true;
+		else if(!strcmp(*it, "--time") && it[1])
+			options.seconds = stod(*++it);
+		else if(!strcmp(*it, "--seed") && it[1])
+			seed = stoul(*++it);
+		else if(!strcmp(*it, "--threads") && it[1])
+			options.threads = max(1, stoi(*++it));
+		else if(!strcmp(*it, "--smooth") && it[1])
+			options.smoothPasses = max(0, stoi(*++it));
+		else if(!strcmp(*it, "--damping") && it[1])
+			options.damping = stod(*++it);
+		else if(!strcmp(*it, "--weight-by-distance"))
+			options.weightByDistance = true;
+		else
+			paths.push_back(*it);
+	}
+	if(paths.size() < 2)
+	{
+		PrintHelp();
 		return 1;
+	}
 
-	srand(time(NULL));
-
-	// Load the "settings."
-	string commodity;
-	int base = 0;
-	vector<double> binWeight;
+	// Load the "settings." A directory stands for all the files in it.
+	vector<string> settings;
+	for(auto it = paths.begin() + 1; it != paths.end(); ++it)
 	{
-		DataFile file(argv[2]);
-		double total = 0.;
-		for(const DataNode &node : file)
+		error_code error;
+		if(!filesystem::is_directory(*it, error))
 		{
-			if(node.Token(0) == "name" && node.Size() >= 2)
-				commodity = node.Token(1);
-			else if(node.Token(0) == "base" && node.Size() >= 2)
-				base = node.Value(1);
-			else if(node.Token(0) == "bins" && node.Size() >= 2)
-				for(int i = 1; i < node.Size(); ++i)
-				{
-					binWeight.push_back(node.Value(i));
-					total += binWeight.back();
-				}
+			settings.push_back(*it);
+			continue;
 		}
-		if(!base || commodity.empty() || binWeight.empty() || !total)
+		vector<string> files;
+		for(filesystem::directory_iterator entry(*it, error), end; !error && entry != end; entry.increment(error))
+		{
+			error_code ignored;
+			if(entry->is_regular_file(ignored) && entry->path().extension() == ".txt")
+				files.push_back(entry->path().string());
+		}
+		if(error)
+		{
+			cerr << "Unable to list the settings in: " << *it << " (" << error.message() << ")" << endl;
 			return 1;
-		for(double &value : binWeight)
-			value /= total;
+		}
+		sort(files.begin(), files.end());
+		settings.insert(settings.end(), files.begin(), files.end());
+	}
+	if(settings.empty())
+	{
+		cerr << "No commodity settings were found." << endl;
+		return 1;
 	}
+	vector<Commodity> commodities(settings.size());
+	for(size_t i = 0; i < settings.size(); ++i)
+		if(!commodities[i].Load(settings[i]))
+		{
+			cerr << "Invalid commodity settings: " << settings[i] << endl;
+			return 1;
+		}
 
-	// Load the map file.
+	// Load the map file, just once for all commodities. To edit it in place,
+	// its source must be kept.
 	map<string, System> systems;
-	vector<string> names;
+	SystemGraph graph;
+	unique_ptr<DataEditor> editor;
+	unique_ptr<DataFile> file;
+	if(inPlace)
+		editor.reset(new DataEditor(paths[0]));
+	else
+		file.reset(new DataFile(paths[0]));
+	auto begin = editor ? editor->begin() : file->begin();
+	auto end = editor ? editor->end() : file->end();
+	for(auto it = begin; it != end; ++it)
+		if(it->Size() >= 2 && it->Token(0) == "system")
+		{
+			systems[it->Token(1)].Load(*it);
+			graph.Add(*it);
+		}
+	graph.Finish();
+
+	// Random numbers are used in alphabetical order of the systems.
+	vector<int> byName;
+	for(const auto &it : systems)
+		byName.push_back(graph.Index(it.first));
+
+	// Price each commodity. The solver is single-threaded, so commodities are
+	// handled in parallel; the randomized search is already parallel, so each
+	// commodity gets all the threads in turn. Each commodity starts from its
+	// own seed, so that any of them can be reproduced separately.
+	vector<vector<int>> prices(commodities.size());
+	vector<unsigned> seeds(commodities.size());
+	vector<char> success(commodities.size());
+	for(size_t i = 0; i < commodities.size(); ++i)
+		seeds[i] = seed + i * options.threads;
+	auto price = [&](int i)
 	{
-		DataFile file(argv[1]);
-		for(const DataNode &node : file)
-			if(node.Size() >= 2 && node.Token(0) == "system")
-			{
-				names.push_back(node.Token(1));
-				systems[node.Token(1)].Load(node);
-			}
+		success[i] = Price(commodities[i], graph, byName, options, seeds[i], prices[i]);
+	};
+	if(options.useRandom)
+	{
+		for(size_t i = 0; i < commodities.size(); ++i)
+			price(i);
+	}
+	else
+	{
+		ThreadPool pool(min<int>(options.threads, commodities.size()));
+		for(size_t i = 0; i < commodities.size(); ++i)
+			pool.Add([&price, i]() { price(i); });
+		pool.Wait();
+	}
+	bool failed = false;
+	for(size_t i = 0; i < commodities.size(); ++i)
+	{
+		if(success[i])
+			cout << commodities[i].name << " seed: " << seeds[i] << endl;
+		failed |= !success[i];
+	}
+	if(failed)
+		return 1;
+
+	// Smooth all the commodities together, as the columns of one matrix with a
+	// row for each system.
+	const int columns = commodities.size();
+	vector<double> matrix(static_cast<size_t>(graph.Size()) * columns);
+	for(int i = 0; i < graph.Size(); ++i)
+		for(int c = 0; c < columns; ++c)
+			matrix[static_cast<size_t>(i) * columns + c] = prices[c][i];
+	GraphSmoother smoother(graph, options.damping, options.weightByDistance);
+	smoother.Smooth(matrix, columns, options.smoothPasses);
+	for(int i = 0; i < graph.Size(); ++i)
+		for(int c = 0; c < columns; ++c)
+			prices[c][i] = floor(matrix[static_cast<size_t>(i) * columns + c] + .5);
+
+	if(inPlace)
+	{
+		// If any edit is rejected, leave the map alone rather than saving it with
+		// some of its old prices still in it.
+		if(!WriteInPlace(*editor, commodities, graph, prices))
+		{
+			cerr << "Unable to update the trade lines in: " << paths[0] << endl;
+			return 1;
+		}
+		if(!editor->Save(paths[0]))
+		{
+			cerr << "Unable to write: " << paths[0] << endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	// Otherwise, write the result. This is not a full map; it needs to be
+	// merged into the map using the map-merge tool.
+	DataWriter out;
+	for(auto &it : systems)
+	{
+		int index = graph.Index(it.first);
+		for(size_t i = 0; i < commodities.size(); ++i)
+			it.second.SetTrade(commodities[i].name, prices[i][index]);
+		it.second.Write(out);
+	}
+	string output = out.ToString();
+
+	{
+		ofstream file(paths[0]);
+		file.write(output.data(), output.length());
 	}
+
+	return 0;
+}
+
+
+
+// Find rough, unsmoothed prices for one commodity. The seed is updated to the
+// one that gave the result, if that was not the first one tried. Returns false
+// if no prices could be found.
+bool Price(const Commodity &commodity, const SystemGraph &graph, const vector<int> &byName,
+	const Options &options, unsigned &seed, vector<int> &prices)
+{
 	// Generate the quotas from the weights.
 	vector<int> binQuota;
-	for(double weight : binWeight)
-		binQuota.push_back(ceil(weight * names.size()) + 1);
+	for(double weight : commodity.binWeight)
+		binQuota.push_back(ceil(weight * graph.Size()) + 1);
 
 	// Look for an arrangement that works.
+	vector<Value> values(graph.Size());
+	mt19937 random(seed);
+	if(options.useRandom)
+	{
+		// A system's bin can affect systems up to one jump less than the
+		// number of bins away.
+		HopDistance hops(graph, binQuota.size() - 1);
+		seed = PortfolioSearch(hops, binQuota, seed, options.threads, random, values);
+	}
+	else
+	{
+		BinSolver solver(graph, binQuota);
+		BinSolver::Result result = solver.Solve(random, options.seconds);
+		if(result == BinSolver::INFEASIBLE)
+		{
+			cerr << commodity.name << ": no assignment of bins satisfies these constraints." << endl;
+			return false;
+		}
+		if(result == BinSolver::TIMED_OUT)
+		{
+			cerr << commodity.name << ": no assignment of bins was found within " << options.seconds
+				<< " seconds (" << solver.Restarts() << " restarts)." << endl;
+			return false;
+		}
+		for(int i = 0; i < graph.Size(); ++i)
+			values[i].bin = solver.Bins()[i];
+	}
+
+	// Assign each star system a value based on its bin.
+	prices.resize(graph.Size());
+	for(int i : byName)
+		prices[i] = commodity.base + (random() % 100) + 100 * values[i].bin;
+	return true;
+}
+
+
+
+// Replace the trade lines for the given commodities in every system, without
+// touching anything else in the map. Systems with no trade line yet for one of
+// them get one added after their other trade lines. Returns false if any of the
+// edits could not be made.
+bool WriteInPlace(DataEditor &editor, const vector<Commodity> &commodities, const SystemGraph &graph,
+	const vector<vector<int>> &prices)
+{
+	map<string, int> column;
+	for(size_t i = 0; i < commodities.size(); ++i)
+		column[commodities[i].name] = i;
+	auto tradeLine = [&](int system, int i)
+	{
+		DataWriter line;
+		line.Write("trade", commodities[i].name, prices[i][system]);
+		return line.ToString();
+	};
+
+	// The first time a system is defined, remember where to add any trade
+	// lines that it is missing.
+	bool success = true;
+	set<pair<int, int>> done;
+	map<int, const DataNode *> firstNode;
+	map<int, const DataNode *> lastTrade;
+	for(const DataNode &node : editor)
+	{
+		if(node.Size() < 2 || node.Token(0) != "system")
+			continue;
+		int system = graph.Index(node.Token(1));
+		firstNode.emplace(system, &node);
+
+		for(const DataNode &child : node)
+		{
+			if(child.Token(0) != "trade" || child.Size() < 3)
+				continue;
+			if(firstNode[system] == &node)
+				lastTrade[system] = &child;
+			auto it = column.find(child.Token(1));
+			if(it == column.end())
+				continue;
+
+			// If a system has more than one line for the same commodity,
+			// only the first one is kept.
+			if(done.emplace(system, it->second).second)
+				success &= editor.ReplaceLine(child, tradeLine(system, it->second));
+			else
+				success &= editor.Remove(child);
+		}
+	}
+	for(const auto &it : firstNode)
+		for(size_t i = 0; i < commodities.size(); ++i)
+		{
+			if(done.count(make_pair(it.first, static_cast<int>(i))))
+				continue;
+			auto tit = lastTrade.find(it.first);
+			if(tit != lastTrade.end())
+				success &= editor.InsertAfter(*tit->second, tradeLine(it.first, i));
+			else
+				success &= editor.AddChild(*it.second, tradeLine(it.first, i));
+		}
+	return success;
+}
+
+
+
+// The original randomized search: assign random bins to random systems, and
+// start over whenever a system is left with no possible bin. This only gives up
+// if told to stop; if no assignment is possible, it must be stopped.
+bool RandomSearch(const HopDistance &hops, const vector<int> &binQuota, mt19937 &random,
+	const atomic<bool> &stop, vector<Value> &values)
+{
 	int highBin = binQuota.size();
-	map<string, Value> values;
-	while(true)
+	HopDistance::Search search;
+	while(!stop)
 	{
 		// We have not assigned any values yet. So, we have our full quota
 		// remaining, and each star can be assigned to any bin.
 		vector<int> bin = binQuota;
-		for(const string &name : names)
+		for(Value &value : values)
 		{
-			values[name].minBin = 0;
-			values[name].maxBin = highBin;
+			value.minBin = 0;
+			value.maxBin = highBin;
 		}
 
 		// Keep track of which stars haven't been assigned values yet.
-		vector<string> unassigned = names;
-		while(unassigned.size())
+		vector<int> unassigned(values.size());
+		for(size_t i = 0; i < unassigned.size(); ++i)
+			unassigned[i] = i;
+		while(unassigned.size() && !stop)
 		{
 			// Pick a random star to assign a value to.
-			int i = rand() % unassigned.size();
-			string name = unassigned[i];
+			int i = random() % unassigned.size();
+			int system = unassigned[i];
 			unassigned[i] = unassigned.back();
 			unassigned.pop_back();
+			Value &value = values[system];
 
 			// Find out how many items left in our quota could be assigned to
 			// this particular star.
 			int possibilities = 0;
-			for(int i = values[name].minBin; i < values[name].maxBin; ++i)
+			for(int i = value.minBin; i < value.maxBin; ++i)
 				possibilities += bin[i];
 			if(!possibilities)
 				break;
 
 			// Pick a random one of those items to assign to it.
-			int index = rand() % possibilities;
-			int choice = values[name].minBin;
+			int index = random() % possibilities;
+			int choice = value.minBin;
 			while(true)
 			{
 				index -= bin[choice];
@@ -160,89 +554,107 @@ int main(int argc, char *argv[])
 			--bin[choice];
 
 			// Record our choice.
-			values[name].bin = choice;
-			int minBin = choice;
-			int maxBin = choice + 1;
-
-			// Starting from this star, trace outwards system by system. Each
-			// neighboring system must be within 1 of this star's level; each
-			// system neighboring those, within 2, and so on.
-			vector<string> source = {name};
-			set<string> done = {name};
-			while(minBin > 0 || maxBin < highBin)
+			value.bin = choice;
+
+			// Each system within d jumps of this star must be within d of
+			// its level. Beyond the distance where that allows every bin,
+			// there is nothing more to narrow down.
+			int reach = max(choice, highBin - 1 - choice);
+			hops.ForEach(system, reach, search, [&](int other, int distance)
 			{
-				// Widen the min and max unless they are at their widest.
-				if(minBin > 0)
-					--minBin;
-				if(maxBin < highBin)
-					++maxBin;
-
-				vector<string> next;
-
-				// Update the min and max for each unvisited neighbor.
-				for(const string &sourceName : source)
-					for(const string &name : systems[sourceName].Links())
-					{
-						if(done.find(name) != done.end())
-							continue;
-						done.insert(name);
-
-						values[name].minBin = max(values[name].minBin, minBin);
-						values[name].maxBin = min(values[name].maxBin, maxBin);
-						next.push_back(name);
-					}
-
-				// Now, visit neighbors of those neighbors.
-				next.swap(source);
-			}
+				Value &neighbor = values[other];
+				neighbor.minBin = max(neighbor.minBin, choice - distance);
+				neighbor.maxBin = min(neighbor.maxBin, choice + 1 + distance);
+			});
 		}
 		// If there were not any stars that we could not assign values to, we
 		// are done. Especially if the constraints are rather tight, it may
 		// take quite a few iterations to find an acceptable solution. Or, it
-		// may be outright impossible, in qhich case the program hangs.
+		// may be outright impossible, in which case this never returns.
 		if(!unassigned.size())
-			break;
+			return true;
 	}
+	return false;
+}
 
-	// Assign each star system a value based on its bin.
-	map<string, int> rough;
-	for(auto &it : values)
-		rough[it.first] = base + (rand() % 100) + 100 * it.second.bin;
 
-	// Smooth out the values by averaging each system with the average of all
-	// its neighbors.
-	for(auto &it : systems)
-	{
-		int count = 0;
-		int sum = 0;
-		for(const string &link : it.second.Links())
-		{
-			sum += rough[link];
-			++count;
-		}
-		if(!count)
-			sum = rough[it.first];
-		else
+
+// Run the randomized search on several threads at once, each seeded with the
+// given seed plus its index. The first to succeed stops all the others. Returns
+// the seed that succeeded, and leaves its generator in the given one so that
+// anything else done with random numbers can also be reproduced.
+unsigned PortfolioSearch(const HopDistance &hops, const vector<int> &binQuota, unsigned seed, int threads,
+	mt19937 &random, vector<Value> &values)
+{
+	atomic<bool> done(false);
+	mutex winnerMutex;
+	unsigned winner = seed;
+
+	vector<thread> workers;
+	for(int i = 0; i < threads; ++i)
+		workers.emplace_back([&, i]()
 		{
-			sum += count * rough[it.first];
-			sum = (sum + count) / (2 * count);
-		}
-		it.second.SetTrade(commodity, sum);
-	}
+			mt19937 generator(seed + i);
+			vector<Value> result(values.size());
+			if(!RandomSearch(hops, binQuota, generator, done, result))
+				return;
+
+			lock_guard<mutex> lock(winnerMutex);
+			if(done.exchange(true))
+				return;
+			winner = seed + i;
+			random = generator;
+			values.swap(result);
+		});
+	for(thread &worker : workers)
+		worker.join();
+
+	return winner;
+}
+
 
-	// Write the result. This is not a full map; it needs to be merged into the
-	// map using the map-merge tool.
-	DataWriter out;
-	for(const auto &it : systems)
-		it.second.Write(out);
-	string output = out.ToString();
 
+void PrintHelp()
+{
+	cerr << endl;
+	cerr << "Usage: $ commerce [--random] [--in-place] [--threads <count>] [--seed <seed>] [--time <seconds>]"
+		" [--smooth <passes>] [--damping <factor>] [--weight-by-distance] <map> <settings>..." << endl;
+	cerr << "   where each <settings> is a commodity file, or a directory of them." << endl;
+	cerr << "   --random: use a randomized search that restarts until it succeeds." << endl;
+	cerr << "   --in-place: only change the trade lines in the map, and keep everything else." << endl;
+	cerr << "   --threads: how many randomized searches to run at once (default: one per core)." << endl;
+	cerr << "   --seed: the random seed to use (default: the current time)." << endl;
+	cerr << "   --time: how long the solver may search before giving up (default 60)." << endl;
+	cerr << "   --smooth: how many times to average each price with its neighbors' (default 1)." << endl;
+	cerr << "   --damping: how much weight each pass gives to the neighbors (default 0.5)." << endl;
+	cerr << "   --weight-by-distance: give closer neighbors more weight." << endl;
+	cerr << endl;
+}
+
+
+
+bool Commodity::Load(const string &path)
+{
+	DataFile file(path);
+	double total = 0.;
+	for(const DataNode &node : file)
 	{
-		ofstream file(argv[1]);
-		file.write(output.data(), output.length());
+		if(node.Token(0) == "name" && node.Size() >= 2)
+			name = node.Token(1);
+		else if(node.Token(0) == "base" && node.Size() >= 2)
+			base = node.Value(1);
+		else if(node.Token(0) == "bins" && node.Size() >= 2)
+			for(int i = 1; i < node.Size(); ++i)
+			{
+				binWeight.push_back(node.Value(i));
+				total += binWeight.back();
+			}
 	}
-
-	return 0;
+	if(!base || name.empty() || binWeight.empty() || !total)
+		return false;
+	for(double &value : binWeight)
+		value /= total;
+	return true;
 }
 
 
@@ -291,3 +703,340 @@ void System::Write(DataWriter &out) const
 	out.EndChild();
 	out.AddLineBreak();
 }
+
+
+
+BinSolver::BinSolver(const SystemGraph &graph, const vector<int> &quota)
+	: graph(graph), quota(quota), binCount(quota.size()),
+	lo(graph.Size()), hi(graph.Size()), bin(graph.Size()),
+	isQueued(graph.Size()), tieBreak(graph.Size())
+{
+}
+
+
+
+BinSolver::Result BinSolver::Solve(mt19937 &random, double seconds)
+{
+	const auto start = chrono::steady_clock::now();
+	const auto deadline = start + chrono::duration<double>(seconds);
+
+	// The number of dead ends allowed before restarting follows the Luby
+	// sequence (1, 1, 2, 1, 1, 2, 4, ...), which grows slowly enough to favor
+	// many short searches but eventually allows a complete one.
+	static const int FAILURE_SCALE = 64;
+	int lubyIndex = 1;
+
+	restarts = 0;
+	vector<Choice> stack;
+	while(true)
+	{
+		Reset(random);
+		// If the constraints cannot be satisfied even before any choices are
+		// made, there is no solution.
+		if(!Propagate())
+			return INFEASIBLE;
+
+		int failures = 0;
+		int limit = FAILURE_SCALE * Luby(lubyIndex++);
+		int steps = 0;
+		bool exhausted = false;
+		stack.clear();
+		while(true)
+		{
+			// Check the clock every so often.
+			if(!(++steps & 255) && chrono::steady_clock::now() > deadline)
+				return TIMED_OUT;
+
+			int system = Choose();
+			if(system < 0)
+				return SOLVED;
+			stack.push_back(Choice{system, trail.size(), OrderBins(system, random), 0});
+
+			// Try the next bin for the most recent choice. If none are left,
+			// go back to the choice before it.
+			while(!stack.empty())
+			{
+				Choice &choice = stack.back();
+				Undo(choice.trail);
+				if(choice.next == choice.bins.size())
+				{
+					stack.pop_back();
+					continue;
+				}
+				if(Assign(choice.system, choice.bins[choice.next++]) && Propagate())
+					break;
+				++failures;
+			}
+			// If every choice has been tried, the search was complete, so
+			// this proves that there is no solution.
+			if(stack.empty())
+			{
+				exhausted = true;
+				break;
+			}
+			if(failures > limit)
+				break;
+		}
+		if(exhausted)
+			return INFEASIBLE;
+		++restarts;
+	}
+}
+
+
+
+const vector<int> &BinSolver::Bins() const
+{
+	return bin;
+}
+
+
+
+int BinSolver::Restarts() const
+{
+	return restarts;
+}
+
+
+
+// Go back to the initial state, with every system able to be in any bin.
+void BinSolver::Reset(mt19937 &random)
+{
+	trail.clear();
+	queue.clear();
+	order = decltype(order)();
+	remaining = quota;
+	counts.assign(binCount * binCount, 0);
+	for(int i = 0; i < graph.Size(); ++i)
+	{
+		lo[i] = 0;
+		hi[i] = binCount - 1;
+		bin[i] = -1;
+		isQueued[i] = false;
+		tieBreak[i] = random();
+		++Count(lo[i], hi[i]);
+		order.emplace(hi[i] - lo[i], -graph.Degree(i), tieBreak[i], i);
+	}
+}
+
+
+
+// Limit the given system to the given range of bins. Returns false if that
+// leaves it with no possible bins.
+bool BinSolver::Narrow(int system, int newLo, int newHi)
+{
+	newLo = max(newLo, lo[system]);
+	newHi = min(newHi, hi[system]);
+	// A system that has not been assigned yet cannot use a bin whose quota is
+	// used up, so its range need not include any such bins at its ends.
+	if(bin[system] < 0)
+	{
+		while(newLo <= newHi && !remaining[newLo])
+			++newLo;
+		while(newLo <= newHi && !remaining[newHi])
+			--newHi;
+	}
+	if(newLo > newHi)
+		return false;
+	if(newLo == lo[system] && newHi == hi[system])
+		return true;
+
+	trail.push_back(Change{system, lo[system], hi[system], false});
+	if(bin[system] < 0)
+	{
+		--Count(lo[system], hi[system]);
+		++Count(newLo, newHi);
+		order.emplace(newHi - newLo, -graph.Degree(system), tieBreak[system], system);
+	}
+	lo[system] = newLo;
+	hi[system] = newHi;
+	Enqueue(system);
+	return true;
+}
+
+
+
+bool BinSolver::Assign(int system, int value)
+{
+	if(!remaining[value])
+		return false;
+
+	trail.push_back(Change{system, lo[system], hi[system], true});
+	--Count(lo[system], hi[system]);
+	--remaining[value];
+	bin[system] = value;
+	lo[system] = value;
+	hi[system] = value;
+	Enqueue(system);
+
+	// If this bin's quota is now used up, no other system can use it.
+	if(!remaining[value])
+		for(int i = 0; i < graph.Size(); ++i)
+			if(bin[i] < 0 && (lo[i] == value || hi[i] == value) && !Narrow(i, lo[i], hi[i]))
+				return false;
+	return true;
+}
+
+
+
+// Spread any changes outwards until every system's range is consistent with
+// the ranges of its neighbors.
+bool BinSolver::Propagate()
+{
+	bool success = true;
+	for(size_t i = 0; i < queue.size() && success; ++i)
+	{
+		int system = queue[i];
+		isQueued[system] = false;
+		for(int neighbor : graph.Links(system))
+			if(!Narrow(neighbor, lo[system] - 1, hi[system] + 1))
+			{
+				success = false;
+				break;
+			}
+	}
+	for(int system : queue)
+		isQueued[system] = false;
+	queue.clear();
+
+	return success && CheckQuotas();
+}
+
+
+
+// Check that, for every range of bins, there is enough quota left in that
+// range for all the unassigned systems that must be somewhere within it.
+bool BinSolver::CheckQuotas() const
+{
+	vector<int> inside(binCount * binCount, 0);
+	for(int first = binCount - 1; first >= 0; --first)
+	{
+		int available = 0;
+		for(int last = first; last < binCount; ++last)
+		{
+			available += remaining[last];
+			int &count = inside[first * binCount + last];
+			count = counts[first * binCount + last];
+			if(last > first)
+			{
+				count += inside[first * binCount + last - 1];
+				if(first + 1 < binCount)
+					count += inside[(first + 1) * binCount + last];
+				if(last - 1 >= first + 1)
+					count -= inside[(first + 1) * binCount + last - 1];
+			}
+			if(count > available)
+				return false;
+		}
+	}
+	return true;
+}
+
+
+
+// Undo every change made since the trail was the given size.
+void BinSolver::Undo(size_t trailSize)
+{
+	while(trail.size() > trailSize)
+	{
+		const Change &change = trail.back();
+		int system = change.system;
+		if(change.assigned)
+		{
+			++remaining[bin[system]];
+			bin[system] = -1;
+		}
+		else if(bin[system] < 0)
+			--Count(lo[system], hi[system]);
+		lo[system] = change.lo;
+		hi[system] = change.hi;
+		if(bin[system] < 0)
+		{
+			++Count(lo[system], hi[system]);
+			order.emplace(hi[system] - lo[system], -graph.Degree(system),
+				tieBreak[system], system);
+		}
+		trail.pop_back();
+	}
+}
+
+
+
+void BinSolver::Enqueue(int system)
+{
+	if(!isQueued[system])
+	{
+		isQueued[system] = true;
+		queue.push_back(system);
+	}
+}
+
+
+
+// Pick the unassigned system with the fewest possible bins, or return -1 if
+// every system has been assigned. Entries for systems whose ranges have
+// changed since they were added are out of date, and are discarded.
+int BinSolver::Choose()
+{
+	while(!order.empty())
+	{
+		const Entry &entry = order.top();
+		int system = get<3>(entry);
+		if(bin[system] < 0 && get<0>(entry) == hi[system] - lo[system])
+			return system;
+		order.pop();
+	}
+	return -1;
+}
+
+
+
+// Put the bins a system could be in into a random order, favoring the bins
+// with the most quota remaining.
+vector<int> BinSolver::OrderBins(int system, mt19937 &random) const
+{
+	vector<int> result;
+	vector<int> weight;
+	int total = 0;
+	for(int i = lo[system]; i <= hi[system]; ++i)
+		if(remaining[i])
+		{
+			result.push_back(i);
+			weight.push_back(remaining[i]);
+			total += remaining[i];
+		}
+	for(size_t i = 0; i < result.size(); ++i)
+	{
+		int index = uniform_int_distribution<int>(0, total - 1)(random);
+		size_t j = i;
+		while(index >= weight[j])
+			index -= weight[j++];
+		swap(result[i], result[j]);
+		swap(weight[i], weight[j]);
+		total -= weight[i];
+	}
+	return result;
+}
+
+
+
+// Get the given term of the Luby sequence, where the first term is 1.
+int BinSolver::Luby(int i)
+{
+	while(true)
+	{
+		int k = 1;
+		while((1 << k) - 1 < i)
+			++k;
+		if(i == (1 << k) - 1)
+			return 1 << (k - 1);
+		i -= (1 << (k - 1)) - 1;
+	}
+}
+
+
+
+int &BinSolver::Count(int first, int last)
+{
+	return counts[first * binCount + last];
+}
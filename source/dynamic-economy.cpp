@@ -14,114 +14,1846 @@ this program. If not, see <https://www.gnu.org/licenses/>.
 */
 
 // Simulator for the dynamic economy implementation. Every time you press <enter>,
-// the simulation steps forward another 1000 days.
-// $ g++ --std=c++11 -o dynamic-economy dynamic-economy.cpp
-// $ ./dynamic-economy path/to/map.txt
+// the simulation steps forward another 1000 days. It can also run without
+// stopping, run ensembles and parameter sweeps, and save and resume its state;
+// run it with no arguments to see all the options.
+// $ g++ --std=c++17 -O2 -pthread -o dynamic-economy dynamic-economy.cpp -lpng -lz
+// $ ./dynamic-economy [options] path/to/map.txt [days]
 
+#include "shared/DataFile.cpp"
+#include "shared/DataNode.cpp"
+#include "shared/Image.cpp"
+#include "shared/Raster.cpp"
+#include "shared/SvgWriter.cpp"
+#include "shared/SystemGraph.cpp"
+#include "shared/ThreadPool.cpp"
+
+#if defined __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <map>
-#include <random>
-#include <set>
-#include <sstream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
+
+using namespace std;
+
+class Checkpoint;
+
+// The constants that control how supply changes from day to day.
+class Parameters {
+public:
+	// Fraction of its supply that each system sends to its neighbors each day.
+	double trade = .10;
+	// Fraction of its supply that each system keeps.
+	double keep = .89;
+	// Size of the random daily fluctuations.
+	double volume = 10000.;
+	// Supply at which prices approach their limits.
+	double limit = 100000.;
+};
+
+// A commodity to simulate, and the parameters to simulate it with.
+class Commodity {
+public:
+	bool Load(const string &path);
+
+	string name;
+	Parameters parameters;
+};
+
+class Options {
+public:
+	int threads = 1;
+	uint64_t seed = 12345;
+	// For the headless modes: how long to run, and how often to take a sample.
+	int64_t days = 0;
+	int interval = 1;
+	string outputPath;
+	bool csv = false;
+	// The kind of file to draw maps as: ".svg", ".svgz", or ".png".
+	string mapExtension = ".svg";
+	// For ensembles: how many runs, and how long to let each one settle
+	// before taking samples.
+	int runs = 0;
+	int64_t burnIn = 1000;
+	int64_t fastForward = 0;
+	// The commodities to simulate. If there are none, a single commodity with
+	// the default parameters is used.
+	vector<Commodity> commodities;
+	// The values to try for each parameter. If these are empty, each commodity
+	// uses its own parameters.
+	vector<double> trade;
+	vector<double> keep;
+	vector<double> volume;
+	vector<double> limit;
+	// Where to save the state of the simulation, and how often.
+	string checkpointPath;
+	int64_t checkpointInterval = 0;
+	// A saved state to start from, if any.
+	shared_ptr<const Checkpoint> resume;
+};
+
+class FastForward;
+
+// Turns random bits into normally distributed numbers with the "ziggurat" method
+// (Marsaglia and Tsang, as improved by Doornik), which covers the bell curve
+// with a stack of rectangles. Almost all the time, the result is just a random
+// point in one of them, which is much faster than transforming the bits with
+// logarithms and trigonometric functions.
+class Ziggurat {
+public:
+	Ziggurat();
+
+	// Get a normally distributed number from 64 random bits. If more bits turn
+	// out to be needed, they come from hashing those ones again.
+	double Normal(uint64_t bits) const;
+
+
+private:
+	// Handle the rare cases where the point picked by Normal() is not entirely
+	// inside the curve.
+	double Retry(uint64_t bits) const;
+
+
+private:
+	static const int LAYERS = 128;
+	// The right edge of each rectangle, and the fraction of each one that is
+	// entirely under the curve.
+	double edge[LAYERS + 1];
+	double inside[LAYERS];
+};
+
+// Makes a fixed number of threads wait for each other. The last thread to
+// arrive runs the given function before any of them are allowed to continue.
+class Barrier {
+public:
+	explicit Barrier(int count);
+
+	void Wait(const function<void()> &last);
+
+
+private:
+	mutex lock;
+	condition_variable released;
+	int count;
+	int waiting = 0;
+	int64_t round = 0;
+};
+
+// The supply of some number of commodities in every system of a map. Each day,
+// every system keeps part of its supply, gains or loses a random amount, and
+// gets an equal share of what each of its neighbors exports. That is a sparse
+// matrix-vector product over the system graph, done by having each system
+// gather from its neighbors into a second buffer so that no system sees
+// another's new supply. That also means that the systems can be divided up
+// between threads. The supply of all the commodities in one system is stored
+// together, as one "lane" per commodity, so the graph only has to be traversed
+// once for all of them, and the innermost loops run over adjacent values.
+class Economy {
+public:
+	Economy(const SystemGraph &graph, const vector<Parameters> &parameters, uint64_t seed);
+
+	// Step forward the given number of days, using the given threads if any.
+	// They are only used if the map is big enough for that to be worthwhile,
+	// and nothing else may be using them in the meantime.
+	void Step(int days, ThreadPool *pool = nullptr);
+
+	int64_t Day() const;
+	int Lanes() const;
+	const Parameters &Lane(int lane) const;
+	// The supply of commodity c in system i is at index i * Lanes() + c.
+	const vector<double> &Supply() const;
+
+	// A normally distributed random number for the given system, commodity,
+	// and day.
+	double Noise(int system, int lane, int64_t day) const;
+
+	// The matrix A for which the supply of the given commodity on the next day
+	// is A times today's supply, plus the random fluctuations, stored row by
+	// row.
+	vector<double> Transition(int lane) const;
+	// The variance of each system's daily random fluctuation.
+	vector<double> NoiseVariance(int lane) const;
+	// Jump ahead by the given number of days, given the combined effect of
+	// stepping through all of them.
+	void Jump(const FastForward &jump);
+
+	// Save the current day and supply, along with what is needed to check that
+	// they are being restored into the same map and economy. The random number
+	// streams depend only on the seed and the day, so those are all that is
+	// needed to continue the same run.
+	bool Save(const string &path) const;
+	// Continue from a saved state. The checkpoint must be for the same map and
+	// number of commodities.
+	void Restore(const Checkpoint &checkpoint);
+
+
+private:
+	// Divide the systems into the given number of runs of consecutive systems
+	// that each take about as long to step.
+	vector<int> Partition(int pieces) const;
+	// Calculate the next day's supply for systems first through last - 1.
+	void StepSystems(int first, int last);
+
+
+private:
+	const SystemGraph &graph;
+	vector<Parameters> parameters;
+	int lanes;
+	uint64_t seed;
+	int64_t day = 0;
+
+	vector<double> keep;
+	vector<double> volume;
+	// The fraction of a system's supply that each neighbor receives from it.
+	vector<double> shareFraction;
+	// The starting point of the random number stream for each system and
+	// commodity.
+	vector<uint64_t> streams;
+	Ziggurat ziggurat;
+
+	vector<double> supply;
+	vector<double> next;
+};
+
+// The combined effect of many days of the simulation. Supply changes by a linear
+// transformation each day, plus independent random noise, so after any number
+// of days it is some matrix M times the starting supply, plus noise whose
+// covariance S is the sum of the noise from each day, propagated forward. Both
+// can be found for 2m days from those for m days: M(2m) = M(m)^2, and
+// S(2m) = S(m) + M(m) S(m) M(m)^T. So, by repeated squaring, any number of days
+// takes only a logarithmic number of matrix multiplications. Samples of the
+// noise are then drawn by factoring S as L L^T and multiplying L by a vector of
+// independent random numbers. Each commodity is independent of the others, so
+// each one has its own M and L.
+class FastForward {
+public:
+	FastForward(const Economy &economy, int64_t days, ThreadPool *pool = nullptr);
+
+	// How many bytes of memory finding a fast-forward takes, at most.
+	static double Memory(int systems, int lanes);
+
+	int64_t Days() const;
+	int Size() const;
+	// The rows of M and L, for the given commodity and system.
+	const double *Transition(int lane, int system) const;
+	const double *Noise(int lane, int system) const;
+
+
+private:
+	void Add(const Economy &economy, int lane, ThreadPool *pool);
+
+
+private:
+	int size;
+	int64_t days;
+	vector<vector<double>> transition;
+	vector<vector<double>> noise;
+};
+
+// Writes samples of every system's supply to a file as the simulation runs, so
+// that nothing but the current day has to be kept in memory. The binary format
+// is, in native byte order:
+// "ESTS", uint32 version (2), uint32 systems, uint32 commodities,
+// uint32 sample interval, uint64 seed, then the name of each system and then of
+// each commodity, each terminated by a zero byte, and then for each sample an
+// int64 day followed by one float32 supply value per commodity, per system.
+// The CSV format has a header row naming each system (and commodity, if there
+// is more than one), and one row per day.
+class SeriesWriter {
+public:
+	bool Open(const string &path, bool csv, const SystemGraph &graph, const vector<string> &commodities,
+		int interval, uint64_t seed);
+	void Write(int64_t day, const vector<double> &supply);
+
+
+private:
+	ofstream out;
+	bool csv = false;
+	vector<float> buffer;
+};
+
+// A saved state of an Economy. The file format is, in native byte order:
+// "ESCP", uint32 version (1), uint32 systems, uint32 commodities, int64 day,
+// uint64 seed, uint64 hash of the map, uint64 hash of the parameters, and then
+// one float64 supply value per commodity, per system. Where possible, the file
+// is memory mapped rather than read, so restoring from it is a single copy.
+class Checkpoint {
+public:
+	// The part of the file before the supply values.
+	class Header {
+	public:
+		char magic[4];
+		uint32_t version;
+		uint32_t systems;
+		uint32_t lanes;
+		int64_t day;
+		uint64_t seed;
+		uint64_t graphHash;
+		uint64_t parameterHash;
+	};
+
+
+public:
+	Checkpoint() = default;
+	~Checkpoint();
+
+	Checkpoint(const Checkpoint &) = delete;
+	Checkpoint &operator=(const Checkpoint &) = delete;
+
+	// Returns false if the file cannot be read or is not a valid checkpoint.
+	bool Load(const string &path);
+
+	const Header &Info() const;
+	const double *Supply() const;
+
+
+private:
+	const char *data = nullptr;
+	size_t size = 0;
+	bool isMapped = false;
+	// If the file could not be mapped, it is read into this instead.
+	vector<char> buffer;
+};
+
+// Statistics of each system's price adjustment (a value between -1 and 1) for
+// each commodity, over any number of samples. The mean and variance are updated one sample at a time
+// (Welford's method), and quantiles are estimated from a histogram, so memory
+// use does not depend on how many samples there are. Statistics gathered from
+// separate runs can be merged.
+class Statistics {
+public:
+	static const int BINS = 200;
+
+
+public:
+	// Keep statistics of the given number of values, which are stored in the
+	// same order as the supply in an Economy.
+	explicit Statistics(int size);
+
+	void Add(const vector<double> &values);
+	void Merge(const Statistics &other);
+
+	int64_t Count() const;
+	double Mean(int index) const;
+	double Variance(int index) const;
+	// Estimate the value that the given fraction of the samples are below.
+	double Quantile(int index, double fraction) const;
+
+
+private:
+	int size;
+	int64_t count = 0;
+	vector<double> mean;
+	vector<double> squares;
+	vector<uint32_t> histogram;
+};
+
+int RunInteractive(const SystemGraph &graph, const Options &options, const vector<string> &args);
+int RunHeadless(const SystemGraph &graph, const Options &options);
+int RunEnsemble(const SystemGraph &graph, const Options &options);
+int RunSweep(const SystemGraph &graph, const Options &options);
+vector<vector<Parameters>> Combinations(const Options &options);
+vector<string> CommodityNames(const Options &options);
+string OutputPath(const string &base, const Options &options, int lane, const string &extension);
+bool LoadCommodities(const string &path, vector<Commodity> &commodities);
+bool ParseValues(const char *text, vector<double> &values);
+string Quote(const string &text);
+void Multiply(const vector<double> &a, const vector<double> &b, vector<double> &result, int size,
+	ThreadPool *pool);
+void MultiplyTransposed(const vector<double> &a, const vector<double> &b, vector<double> &result, int size,
+	ThreadPool *pool);
+double PhysicalMemory();
+uint64_t Mix(uint64_t x);
+double Uniform(uint64_t bits);
+uint64_t GraphHash(const SystemGraph &graph);
+uint64_t ParameterHash(const vector<Parameters> &parameters);
+void DrawMap(const SystemGraph &graph, const vector<double> &values, const string &path);
+void MapColor(double value, double *r, double *g, double *b);
+void PrintHelp();
+
+
+
+int main(int, char *argv[])
+{
+	Options options;
+	options.threads = ThreadPool::DefaultSize();
+	bool valid = true;
+	bool hasSeed = false;
+	string resumePath;
+	vector<string> args;
+	for(char **it = argv + 1; *it; ++it)
+	{
+		if(!strcmp(*it, "--threads") && it[1])
+			options.threads = max(1, stoi(*++it));
+		else if(!strcmp(*it, "--seed") && it[1])
+		{
+			options.seed = stoull(*++it);
+			hasSeed = true;
+		}
+		else if(!strcmp(*it, "--days") && it[1])
+			options.days = stoll(*++it);
+		else if(!strcmp(*it, "--sample") && it[1])
+			options.interval = max(1, stoi(*++it));
+		else if(!strcmp(*it, "--output") && it[1])
+			options.outputPath = *++it;
+		else if(!strcmp(*it, "--csv"))
+			options.csv = true;
+		else if(!strcmp(*it, "--png"))
+			options.mapExtension = ".png";
+		else if(!strcmp(*it, "--svgz"))
+			options.mapExtension = ".svgz";
+		else if(!strcmp(*it, "--ensemble") && it[1])
+			options.runs = max(1, stoi(*++it));
+		else if(!strcmp(*it, "--burn-in") && it[1])
+			options.burnIn = max(0ll, stoll(*++it));
+		else if(!strcmp(*it, "--fast-forward") && it[1])
+			options.fastForward = max(0ll, stoll(*++it));
+		else if(!strcmp(*it, "--trade") && it[1])
+			valid &= ParseValues(*++it, options.trade);
+		else if(!strcmp(*it, "--keep") && it[1])
+			valid &= ParseValues(*++it, options.keep);
+		else if(!strcmp(*it, "--volume") && it[1])
+			valid &= ParseValues(*++it, options.volume);
+		else if(!strcmp(*it, "--limit") && it[1])
+			valid &= ParseValues(*++it, options.limit);
+		else if(!strcmp(*it, "--checkpoint") && it[1])
+			options.checkpointPath = *++it;
+		else if(!strcmp(*it, "--checkpoint-every") && it[1])
+			options.checkpointInterval = max(0ll, stoll(*++it));
+		else if(!strcmp(*it, "--resume") && it[1])
+			resumePath = *++it;
+		else if(!strcmp(*it, "--commodity") && it[1])
+		{
+			if(!LoadCommodities(*++it, options.commodities))
+			{
+				cerr << "Invalid commodity: " << *it << endl;
+				return 1;
+			}
+		}
+		else
+			args.push_back(*it);
+	}
+	if(options.commodities.empty())
+		options.commodities.emplace_back();
+	if(!valid || args.empty() || (options.days > 0) != !options.outputPath.empty())
+	{
+		PrintHelp();
+		return 1;
+	}
+	bool sweep = (Combinations(options).size() > 1);
+	if(sweep && (options.runs || !options.days))
+	{
+		cerr << "A parameter sweep needs --days and --output, and cannot be an ensemble." << endl;
+		return 1;
+	}
+
+	DataFile file(args[0]);
+	SystemGraph graph(file);
+	if(options.fastForward)
+	{
+		// Each of the parameter combinations that a sweep runs at once needs
+		// its own fast-forward.
+		const double copies = sweep ? min<size_t>(options.threads, Combinations(options).size()) : 1;
+		const double needed = copies * FastForward::Memory(graph.Size(), options.commodities.size());
+		const double available = PhysicalMemory() * .75;
+		if(needed > available)
+		{
+			const double GB = 1024. * 1024. * 1024.;
+			cerr << "Fast-forwarding this map would take " << needed / GB << " GB of memory, but only "
+				<< available / GB << " GB can be used." << endl;
+			return 1;
+		}
+	}
+
+	if(!resumePath.empty())
+	{
+		shared_ptr<Checkpoint> checkpoint(new Checkpoint);
+		if(!checkpoint->Load(resumePath))
+		{
+			cerr << "Not a valid checkpoint: " << resumePath << endl;
+			return 1;
+		}
+		const Checkpoint::Header &info = checkpoint->Info();
+		if(options.fastForward)
+		{
+			cerr << "A resumed run cannot also be fast-forwarded." << endl;
+			return 1;
+		}
+		if(info.systems != static_cast<uint32_t>(graph.Size()) || info.graphHash != GraphHash(graph)
+				|| info.lanes != options.commodities.size())
+		{
+			cerr << "That checkpoint is for a different map or set of commodities." << endl;
+			return 1;
+		}
+		// Changing the parameters is allowed, since that is one of the things
+		// that one might want to try from a saved state, but it is probably a
+		// mistake if it is not a sweep.
+		if(!sweep && info.parameterHash != ParameterHash(Combinations(options).front()))
+			cerr << "Warning: that checkpoint was saved with different parameters." << endl;
+		if(!hasSeed)
+			options.seed = info.seed;
+		options.resume = checkpoint;
+	}
+
+	if(sweep)
+		return RunSweep(graph, options);
+	if(options.runs)
+		return RunEnsemble(graph, options);
+	if(options.days > 0)
+		return RunHeadless(graph, options);
+	return RunInteractive(graph, options, args);
+}
+
+
+
+// Run the simulation, drawing the map every time the user presses enter.
+int RunInteractive(const SystemGraph &graph, const Options &options, const vector<string> &args)
+{
+	Economy economy(graph, Combinations(options).front(), options.seed);
+	ThreadPool pool(options.threads);
+	if(options.resume)
+		economy.Restore(*options.resume);
+	else if(options.fastForward)
+		economy.Jump(FastForward(economy, options.fastForward, &pool));
+
+	const int lanes = economy.Lanes();
+	vector<string> names = CommodityNames(options);
+	vector<double> values(graph.Size());
+	int DAYS = 1000;
+	while(true)
+	{
+		economy.Step(DAYS, &pool);
+		// After the first day, step according to the given step size.
+		if(args.size() > 1)
+			DAYS = stoi(args[1]);
+
+		for(int c = 0; c < lanes; ++c)
+		{
+			double lowest = 1.;
+			double highest = -1.;
+			for(int i = 0; i < graph.Size(); ++i)
+			{
+				values[i] = erf(economy.Supply()[i * lanes + c] / economy.Lane(c).limit);
+				lowest = min(values[i], lowest);
+				highest = max(values[i], highest);
+			}
+			DrawMap(graph, values, OutputPath("economy", options, c, options.mapExtension));
+
+			if(lanes > 1)
+				cout << names[c] << ": " << lowest << " to " << highest << endl;
+			else
+				cout << "Adjustment range: " << lowest << " to " << highest;
+		}
+		if(!options.checkpointPath.empty() && !economy.Save(options.checkpointPath))
+		{
+			cerr << "Unable to write: " << options.checkpointPath << endl;
+			return 1;
+		}
+		cin.get();
+		if(!cin)
+			break;
+	}
+	cout << endl;
+	return 0;
+}
+
+
+
+// Run for the given number of days, saving a sample of the supply at the
+// given interval.
+int RunHeadless(const SystemGraph &graph, const Options &options)
+{
+	Economy economy(graph, Combinations(options).front(), options.seed);
+	ThreadPool pool(options.threads);
+	if(options.resume)
+		economy.Restore(*options.resume);
+	else if(options.fastForward)
+		economy.Jump(FastForward(economy, options.fastForward, &pool));
+
+	SeriesWriter series;
+	if(!series.Open(options.outputPath, options.csv, graph, CommodityNames(options), options.interval,
+			options.seed))
+	{
+		cerr << "Unable to write: " << options.outputPath << endl;
+		return 1;
+	}
+	int64_t saved = economy.Day();
+	while(economy.Day() < options.days)
+	{
+		economy.Step(min<int64_t>(options.interval, options.days - economy.Day()), &pool);
+		series.Write(economy.Day(), economy.Supply());
+
+		bool isDue = (options.checkpointInterval && economy.Day() - saved >= options.checkpointInterval);
+		if(!options.checkpointPath.empty() && (isDue || economy.Day() >= options.days))
+		{
+			if(!economy.Save(options.checkpointPath))
+			{
+				cerr << "Unable to write: " << options.checkpointPath << endl;
+				return 1;
+			}
+			saved = economy.Day();
+		}
+	}
+	return 0;
+}
+
+
+
+// Run the simulation once for each seed from the given one onwards, and gather
+// statistics of the price adjustments after the burn-in period. Rather than
+// having the threads wait for each other every day, the runs are divided up
+// between them, and each thread keeps its own statistics.
+int RunEnsemble(const SystemGraph &graph, const Options &options)
+{
+	vector<Parameters> parameters = Combinations(options).front();
+	const int lanes = parameters.size();
+	const int size = graph.Size() * lanes;
+	ThreadPool pool(options.threads);
+	// Every run can share the same fast-forward, since that does not depend
+	// on the seed.
+	unique_ptr<FastForward> jump;
+	if(options.fastForward)
+		jump.reset(new FastForward(Economy(graph, parameters, options.seed), options.fastForward, &pool));
+
+	mutex statisticsMutex;
+	map<int, Statistics> pieces;
+	pool.ForEach(0, options.runs, [&](int first, int last)
+	{
+		Statistics statistics(size);
+		vector<double> values(size);
+		for(int run = first; run < last; ++run)
+		{
+			Economy economy(graph, parameters, options.seed + run);
+			if(options.resume)
+				economy.Restore(*options.resume);
+			else if(jump)
+				economy.Jump(*jump);
+			economy.Step(max<int64_t>(0, min(options.burnIn, options.days) - economy.Day()));
+			while(economy.Day() < options.days)
+			{
+				economy.Step(min<int64_t>(options.interval, options.days - economy.Day()));
+				for(int i = 0; i < size; ++i)
+					values[i] = erf(economy.Supply()[i] / parameters[i % lanes].limit);
+				statistics.Add(values);
+			}
+		}
+		lock_guard<mutex> lock(statisticsMutex);
+		pieces.emplace(first, std::move(statistics));
+	});
+	// Merge the statistics in a fixed order, so the result does not depend on
+	// which thread happened to finish first.
+	Statistics statistics(size);
+	for(const auto &it : pieces)
+		statistics.Merge(it.second);
+	if(!statistics.Count())
+	{
+		cerr << "No samples were taken; the burn-in is longer than the run." << endl;
+		return 1;
+	}
+
+	string path = options.outputPath + ".csv";
+	ofstream out(path);
+	if(!out)
+	{
+		cerr << "Unable to write: " << path << endl;
+		return 1;
+	}
+	vector<string> names = CommodityNames(options);
+	out << (lanes > 1 ? "system,commodity," : "system,") << "mean,deviation,5%,median,95%\n";
+	for(int i = 0; i < graph.Size(); ++i)
+		for(int c = 0; c < lanes; ++c)
+		{
+			int index = i * lanes + c;
+			out << Quote(graph.Name(i)) << ',';
+			if(lanes > 1)
+				out << Quote(names[c]) << ',';
+			out << statistics.Mean(index) << ',' << sqrt(statistics.Variance(index))
+				<< ',' << statistics.Quantile(index, .05) << ',' << statistics.Quantile(index, .5)
+				<< ',' << statistics.Quantile(index, .95) << '\n';
+		}
+
+	cout << statistics.Count() << " samples from " << options.runs << " runs." << endl;
+	vector<double> means(graph.Size());
+	for(int c = 0; c < lanes; ++c)
+	{
+		double lowest = 1.;
+		double highest = -1.;
+		for(int i = 0; i < graph.Size(); ++i)
+		{
+			means[i] = statistics.Mean(i * lanes + c);
+			lowest = min(means[i], lowest);
+			highest = max(means[i], highest);
+		}
+		DrawMap(graph, means, OutputPath(options.outputPath, options, c, options.mapExtension));
+		if(lanes > 1)
+			cout << names[c] << ": ";
+		cout << "Average adjustment range: " << lowest << " to " << highest << endl;
+	}
+	return 0;
+}
+
+
+
+// Simulate every combination of the given parameter values with the same seed,
+// and write a summary of how each one behaved after the burn-in. Like the runs
+// in an ensemble, the combinations are divided up between the threads.
+int RunSweep(const SystemGraph &graph, const Options &options)
+{
+	// The summary of each combination, for each commodity: the range of price
+	// adjustments on the last day, the typical size of the adjustments over the
+	// whole run, and how strongly each sample is correlated with the one
+	// before it.
+	class Summary {
+	public:
+		double lowest = 1.;
+		double highest = -1.;
+		double deviation = 0.;
+		double correlation = 0.;
+	};
+
+	vector<vector<Parameters>> combinations = Combinations(options);
+	const int lanes = options.commodities.size();
+	vector<Summary> summaries(combinations.size() * lanes);
+	ThreadPool pool(min<int>(options.threads, combinations.size()));
+	pool.ForEach(0, combinations.size(), [&](int first, int last)
+	{
+		const int systems = graph.Size();
+		const int size = systems * lanes;
+		// The mean and variance of each system's supply are updated one sample
+		// at a time, as in Statistics. So is the covariance of each pair of
+		// consecutive samples, which needs the mean of the earlier and of the
+		// later sample in each pair.
+		vector<double> mean(size);
+		vector<double> squares(size);
+		vector<double> earlierMean(size);
+		vector<double> laterMean(size);
+		vector<double> products(size);
+		vector<double> previous(size);
+		vector<double> adjustments(lanes);
+		for(int p = first; p < last; ++p)
+		{
+			const vector<Parameters> &parameters = combinations[p];
+			Economy economy(graph, parameters, options.seed);
+			if(options.resume)
+				economy.Restore(*options.resume);
+			else if(options.fastForward)
+				economy.Jump(FastForward(economy, options.fastForward));
+			economy.Step(max<int64_t>(0, min(options.burnIn, options.days) - economy.Day()));
+			for(vector<double> *sums : {&mean, &squares, &earlierMean, &laterMean, &products, &adjustments})
+				fill(sums->begin(), sums->end(), 0.);
+			int64_t samples = 0;
+			while(economy.Day() < options.days)
+			{
+				economy.Step(min<int64_t>(options.interval, options.days - economy.Day()));
+				const vector<double> &supply = economy.Supply();
+				++samples;
+				// The first sample after the burn-in is not paired with anything.
+				const int64_t pairs = samples - 1;
+				for(int i = 0; i < size; ++i)
+				{
+					double delta = supply[i] - mean[i];
+					mean[i] += delta / samples;
+					squares[i] += delta * (supply[i] - mean[i]);
+					if(pairs)
+					{
+						earlierMean[i] += (previous[i] - earlierMean[i]) / pairs;
+						double later = supply[i] - laterMean[i];
+						laterMean[i] += later / pairs;
+						products[i] += (previous[i] - earlierMean[i]) * later;
+					}
+					double value = erf(supply[i] / parameters[i % lanes].limit);
+					adjustments[i % lanes] += value * value;
+				}
+				previous = supply;
+			}
+
+			for(int c = 0; c < lanes; ++c)
+			{
+				Summary &summary = summaries[p * lanes + c];
+				for(int i = 0; i < systems; ++i)
+				{
+					double value = erf(economy.Supply()[i * lanes + c] / parameters[c].limit);
+					summary.lowest = min(value, summary.lowest);
+					summary.highest = max(value, summary.highest);
+				}
+				if(!samples)
+					continue;
+				summary.deviation = sqrt(adjustments[c] / (samples * systems));
+				// Average the lag-one autocorrelation over all the systems that
+				// have any variation at all.
+				int counted = 0;
+				for(int i = c; i < size; i += lanes)
+				{
+					if(samples < 2 || squares[i] <= 0.)
+						continue;
+					summary.correlation += (products[i] / (samples - 1)) / (squares[i] / samples);
+					++counted;
+				}
+				if(counted)
+					summary.correlation /= counted;
+			}
+		}
+	});
+
+	ofstream out(options.outputPath);
+	if(!out)
+	{
+		cerr << "Unable to write: " << options.outputPath << endl;
+		return 1;
+	}
+	vector<string> names = CommodityNames(options);
+	if(lanes > 1)
+		out << "commodity,";
+	out << "trade,keep,volume,limit,lowest,highest,deviation,autocorrelation,correlation time\n";
+	for(size_t p = 0; p < combinations.size(); ++p)
+		for(int c = 0; c < lanes; ++c)
+		{
+			const Parameters &parameters = combinations[p][c];
+			const Summary &summary = summaries[p * lanes + c];
+			// The correlation time is how many days it takes for the
+			// correlation between samples to fall by a factor of e.
+			double time = 0.;
+			if(summary.correlation >= 1.)
+				time = INFINITY;
+			else if(summary.correlation > 0.)
+				time = -options.interval / log(summary.correlation);
+			if(lanes > 1)
+				out << Quote(names[c]) << ',';
+			out << parameters.trade << ',' << parameters.keep << ',' << parameters.volume << ','
+				<< parameters.limit << ',' << summary.lowest << ',' << summary.highest << ','
+				<< summary.deviation << ',' << summary.correlation << ',' << time << '\n';
+		}
+	return 0;
+}
+
+
+
+// Get every combination of the parameter values given on the command line. For
+// each combination, this gives the parameters for each commodity.
+vector<vector<Parameters>> Combinations(const Options &options)
+{
+	vector<vector<Parameters>> result(1);
+	for(const Commodity &commodity : options.commodities)
+		result.front().push_back(commodity.parameters);
+	auto expand = [&result](const vector<double> &values, void (*set)(Parameters &, double))
+	{
+		if(values.empty())
+			return;
+		vector<vector<Parameters>> expanded;
+		for(const vector<Parameters> &lanes : result)
+			for(double value : values)
+			{
+				expanded.push_back(lanes);
+				for(Parameters &parameters : expanded.back())
+					set(parameters, value);
+			}
+		result.swap(expanded);
+	};
+	expand(options.trade, [](Parameters &parameters, double value) { parameters.trade = value; });
+	expand(options.keep, [](Parameters &parameters, double value) { parameters.keep = value; });
+	expand(options.volume, [](Parameters &parameters, double value) { parameters.volume = value; });
+	expand(options.limit, [](Parameters &parameters, double value) { parameters.limit = value; });
+	return result;
+}
+
+
+
+vector<string> CommodityNames(const Options &options)
+{
+	vector<string> names;
+	for(const Commodity &commodity : options.commodities)
+		names.push_back(commodity.name);
+	return names;
+}
+
+
+
+// Get the path to write the output for one commodity to. If there is only one
+// commodity, its name is left out.
+string OutputPath(const string &base, const Options &options, int lane, const string &extension)
+{
+	if(options.commodities.size() == 1)
+		return base + extension;
+
+	string name;
+	for(char c : options.commodities[lane].name)
+		name += isalnum(c) ? tolower(c) : '-';
+	return base + '-' + name + extension;
+}
+
+
+
+// Load a commodity file, or every commodity file in a directory.
+bool LoadCommodities(const string &path, vector<Commodity> &commodities)
+{
+	vector<string> files;
+	if(filesystem::is_directory(path))
+	{
+		for(const auto &entry : filesystem::directory_iterator(path))
+			if(entry.is_regular_file() && entry.path().extension() == ".txt")
+				files.push_back(entry.path().string());
+		sort(files.begin(), files.end());
+	}
+	else
+		files.push_back(path);
+
+	for(const string &file : files)
+	{
+		commodities.emplace_back();
+		if(!commodities.back().Load(file))
+			return false;
+	}
+	return !files.empty();
+}
+
+
+
+// Parse a single value, a comma-separated list of values, or a range given as
+// "start:end:steps". Returns false if the text is not in any of those forms.
+bool ParseValues(const char *text, vector<double> &values)
+{
+	values.clear();
+	vector<double> numbers;
+	char separator = 0;
+	while(true)
+	{
+		char *end = nullptr;
+		numbers.push_back(strtod(text, &end));
+		if(end == text)
+			return false;
+		if(!*end)
+			break;
+		// Don't allow mixing commas and colons.
+		if((*end != ',' && *end != ':') || (separator && *end != separator))
+			return false;
+		separator = *end;
+		text = end + 1;
+	}
+
+	if(separator != ':')
+	{
+		values.swap(numbers);
+		return true;
+	}
+	int steps = numbers.size() == 3 ? numbers[2] : 0;
+	if(steps < 1 || steps != numbers[2])
+		return false;
+	for(int i = 0; i < steps; ++i)
+		values.push_back(steps == 1 ? numbers[0] : numbers[0] + (numbers[1] - numbers[0]) * i / (steps - 1));
+	return true;
+}
+
+
+
+// Quote a string for a CSV file if it contains anything that would otherwise
+// break up the row.
+string Quote(const string &text)
+{
+	if(text.find_first_of(",\"\n") == string::npos)
+		return text;
+
+	string result = "\"";
+	for(char c : text)
+	{
+		if(c == '"')
+			result += '"';
+		result += c;
+	}
+	return result + '"';
+}
+
+
+
+bool Commodity::Load(const string &path)
+{
+	DataFile file(path);
+	for(const DataNode &node : file)
+	{
+		if(node.Token(0) == "name" && node.Size() >= 2)
+			name = node.Token(1);
+		else if(node.Token(0) == "trade" && node.Size() >= 2)
+			parameters.trade = node.Value(1);
+		else if(node.Token(0) == "keep" && node.Size() >= 2)
+			parameters.keep = node.Value(1);
+		else if(node.Token(0) == "volume" && node.Size() >= 2)
+			parameters.volume = node.Value(1);
+		else if(node.Token(0) == "limit" && node.Size() >= 2)
+			parameters.limit = node.Value(1);
+	}
+	return !name.empty();
+}
+
+
+
+Economy::Economy(const SystemGraph &graph, const vector<Parameters> &parameters, uint64_t seed)
+	: graph(graph), parameters(parameters), lanes(parameters.size()), seed(seed),
+	keep(lanes), volume(lanes), shareFraction(static_cast<size_t>(graph.Size()) * lanes),
+	streams(static_cast<size_t>(graph.Size()) * lanes),
+	supply(static_cast<size_t>(graph.Size()) * lanes), next(static_cast<size_t>(graph.Size()) * lanes)
+{
+	for(int c = 0; c < lanes; ++c)
+	{
+		keep[c] = parameters[c].keep;
+		volume[c] = parameters[c].volume;
+	}
+	for(int i = 0; i < graph.Size(); ++i)
+	{
+		int degree = graph.Degree(i);
+		for(int c = 0; c < lanes; ++c)
+		{
+			shareFraction[i * lanes + c] = degree ? parameters[c].trade / degree : 0.;
+			streams[i * lanes + c] = Mix((seed ^ Mix(i)) + c * 0x9E3779B97F4A7C15ull);
+		}
+	}
+}
+
+
+
+void Economy::Step(int days, ThreadPool *pool)
+{
+	// Stepping a system takes time in proportion to its links plus one, for
+	// each commodity. Each thread must have enough of that to do each day to
+	// make up for the time spent waiting for the others.
+	const int64_t MIN_WORK = 1 << 14;
+	const int size = graph.Size();
+	const int64_t work = (static_cast<int64_t>(size) + graph.Offsets().back()) * lanes;
+	const int pieces = pool ? min<int64_t>(pool->Size(), work / MIN_WORK) : 1;
+	if(pieces <= 1)
+	{
+		for(int64_t end = day + days; day < end; ++day)
+		{
+			StepSystems(0, size);
+			supply.swap(next);
+		}
+		return;
+	}
+
+	// Each system only depends on its neighbors' supply on the previous day, so
+	// the threads only need to wait for each other once per day. Each one
+	// steps its own share of the systems for all the days.
+	const vector<int> bounds = Partition(pieces);
+	Barrier barrier(pieces);
+	pool->ForEach(0, pieces, [this, days, &bounds, &barrier](int first, int last)
+	{
+		for(int i = 0; i < days; ++i)
+		{
+			StepSystems(bounds[first], bounds[last]);
+			barrier.Wait([this]()
+			{
+				supply.swap(next);
+				++day;
+			});
+		}
+	});
+}
+
+
+
+vector<int> Economy::Partition(int pieces) const
+{
+	// The work done by the time system i is reached is i + offsets[i], which
+	// only increases, so each boundary can be found by a binary search.
+	const int size = graph.Size();
+	const int *offsets = graph.Offsets().data();
+	const int64_t total = static_cast<int64_t>(size) + offsets[size];
+	vector<int> bounds(pieces + 1, size);
+	bounds[0] = 0;
+	for(int k = 1; k < pieces; ++k)
+	{
+		const int64_t share = total * k / pieces;
+		int low = bounds[k - 1];
+		int high = size;
+		while(low < high)
+		{
+			int middle = low + (high - low) / 2;
+			if(middle + offsets[middle] < share)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+		bounds[k] = low;
+	}
+	return bounds;
+}
+
+
+
+void Economy::StepSystems(int first, int last)
+{
+	const int *offsets = graph.Offsets().data();
+	const int *targets = graph.Targets().data();
+	vector<double> imports(lanes);
+	for(int i = first; i < last; ++i)
+	{
+		const double *in = supply.data() + static_cast<size_t>(i) * lanes;
+		double *out = next.data() + static_cast<size_t>(i) * lanes;
+		// Systems with no links are not part of the economy.
+		if(offsets[i] == offsets[i + 1])
+		{
+			copy(in, in + lanes, out);
+			continue;
+		}
+		fill(imports.begin(), imports.end(), 0.);
+		for(int e = offsets[i]; e < offsets[i + 1]; ++e)
+		{
+			const size_t j = static_cast<size_t>(targets[e]) * lanes;
+			const double *share = shareFraction.data() + j;
+			const double *neighbor = supply.data() + j;
+			for(int c = 0; c < lanes; ++c)
+				imports[c] += share[c] * neighbor[c];
+		}
+		for(int c = 0; c < lanes; ++c)
+			out[c] = keep[c] * in[c] + volume[c] * Noise(i, c, day) + imports[c];
+	}
+}
+
+
+
+int64_t Economy::Day() const
+{
+	return day;
+}
+
+
+
+int Economy::Lanes() const
+{
+	return lanes;
+}
+
+
+
+const Parameters &Economy::Lane(int lane) const
+{
+	return parameters[lane];
+}
+
+
+
+const vector<double> &Economy::Supply() const
+{
+	return supply;
+}
+
+
+
+double Economy::Noise(int system, int lane, int64_t day) const
+{
+	return ziggurat.Normal(Mix(streams[static_cast<size_t>(system) * lanes + lane] + day));
+}
+
+
+
+vector<double> Economy::Transition(int lane) const
+{
+	const int size = graph.Size();
+	vector<double> result(static_cast<size_t>(size) * size);
+	for(int i = 0; i < size; ++i)
+	{
+		double *row = result.data() + static_cast<size_t>(i) * size;
+		if(!graph.Degree(i))
+		{
+			row[i] = 1.;
+			continue;
+		}
+		row[i] = keep[lane];
+		for(int link : graph.Links(i))
+			row[link] += shareFraction[link * lanes + lane];
+	}
+	return result;
+}
+
+
+
+vector<double> Economy::NoiseVariance(int lane) const
+{
+	vector<double> result(graph.Size());
+	for(int i = 0; i < graph.Size(); ++i)
+		if(graph.Degree(i))
+			result[i] = volume[lane] * volume[lane];
+	return result;
+}
+
+
+
+void Economy::Jump(const FastForward &jump)
+{
+	// The random numbers for a jump come from a part of each system's stream
+	// that ordinary steps will never reach.
+	const int64_t JUMP_STREAM = 1ll << 62;
+	const int size = graph.Size();
+	vector<double> random(static_cast<size_t>(size) * lanes);
+	for(int i = 0; i < size; ++i)
+		for(int c = 0; c < lanes; ++c)
+			random[static_cast<size_t>(i) * lanes + c] = Noise(i, c, JUMP_STREAM + day);
+
+	for(int c = 0; c < lanes; ++c)
+		for(int i = 0; i < size; ++i)
+		{
+			const double *transition = jump.Transition(c, i);
+			const double *noise = jump.Noise(c, i);
+			double sum = 0.;
+			for(int j = 0; j < size; ++j)
+				sum += transition[j] * supply[static_cast<size_t>(j) * lanes + c];
+			for(int j = 0; j <= i; ++j)
+				sum += noise[j] * random[static_cast<size_t>(j) * lanes + c];
+			next[static_cast<size_t>(i) * lanes + c] = sum;
+		}
+	supply.swap(next);
+	day += jump.Days();
+}
+
+
+
+bool Economy::Save(const string &path) const
+{
+	Checkpoint::Header header;
+	memcpy(header.magic, "ESCP", 4);
+	header.version = 1;
+	header.systems = graph.Size();
+	header.lanes = lanes;
+	header.day = day;
+	header.seed = seed;
+	header.graphHash = GraphHash(graph);
+	header.parameterHash = ParameterHash(parameters);
+
+	// Write to a temporary file first, so that if this is interrupted, the
+	// previous checkpoint is still intact.
+	string temp = path + ".tmp";
+	{
+		ofstream out(temp, ios::binary);
+		out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		out.write(reinterpret_cast<const char *>(supply.data()), supply.size() * sizeof(double));
+		if(!out.flush())
+			return false;
+	}
+	return !rename(temp.c_str(), path.c_str());
+}
+
+
+
+void Economy::Restore(const Checkpoint &checkpoint)
+{
+	day = checkpoint.Info().day;
+	copy(checkpoint.Supply(), checkpoint.Supply() + supply.size(), supply.begin());
+}
+
+
+
+Barrier::Barrier(int count)
+	: count(count)
+{
+}
+
+
+
+void Barrier::Wait(const function<void()> &last)
+{
+	unique_lock<mutex> guard(lock);
+	if(++waiting == count)
+	{
+		last();
+		waiting = 0;
+		++round;
+		released.notify_all();
+		return;
+	}
+	const int64_t current = round;
+	released.wait(guard, [this, current]() { return round != current; });
+}
+
+
+
+// The finished M and L of every commodity, plus, while each commodity's are being
+// found, four more matrices: the covariance, the current power of two and its
+// noise, and the products of the squaring.
+double FastForward::Memory(int systems, int lanes)
+{
+	return (2. * lanes + 4.) * systems * systems * sizeof(double);
+}
 
-using namespace std;
 
-bool StartsWith(const string &line, const string &str)
+
+FastForward::FastForward(const Economy &economy, int64_t days, ThreadPool *pool)
+	: size(economy.Supply().size() / economy.Lanes()), days(days),
+	transition(economy.Lanes()), noise(economy.Lanes())
 {
-	return line.length() >= str.length() && !line.compare(0, str.length(), str);
+	for(int lane = 0; lane < economy.Lanes(); ++lane)
+		Add(economy, lane, pool);
 }
 
-string Token(const string &line, int index)
+
+
+// Find M and L for one commodity.
+void FastForward::Add(const Economy &economy, int lane, ThreadPool *pool)
 {
-	size_t pos = 0;
+	vector<double> &transition = this->transition[lane];
+	vector<double> &noise = this->noise[lane];
+	const size_t area = static_cast<size_t>(size) * size;
+	// The effect of a power-of-two number of days, starting with one day.
+	vector<double> power = economy.Transition(lane);
+	vector<double> powerNoise(area);
+	vector<double> variance = economy.NoiseVariance(lane);
+	for(int i = 0; i < size; ++i)
+		powerNoise[static_cast<size_t>(i) * size + i] = variance[i];
+
+	// The combined effect of the powers of two that have been used so far.
+	transition.assign(area, 0.);
+	for(int i = 0; i < size; ++i)
+		transition[static_cast<size_t>(i) * size + i] = 1.;
+	vector<double> covariance(area);
 
-	while(pos < line.length())
+	vector<double> product(area);
+	vector<double> scratch(area);
+	// Add the effect of some number of days to the effect of the days before.
+	auto combine = [&](vector<double> &m, vector<double> &s, const vector<double> &nextM,
+		const vector<double> &nextS)
+	{
+		Multiply(nextM, s, product, size, pool);
+		MultiplyTransposed(product, nextM, scratch, size, pool);
+		for(size_t i = 0; i < area; ++i)
+			s[i] = scratch[i] + nextS[i];
+		Multiply(nextM, m, scratch, size, pool);
+		m.swap(scratch);
+	};
+	// Once the starting supply has no noticeable effect any more, the economy
+	// has reached its long-run state, and more days make no difference. The
+	// only part of the transition left then is that the systems that are not
+	// part of the economy stay the same.
+	auto isSettled = [&]()
+	{
+		for(int i = 0; i < size; ++i)
+		{
+			const double *row = power.data() + static_cast<size_t>(i) * size;
+			for(int j = 0; j < size; ++j)
+				if(fabs(row[j] - (i == j && row[j] == 1.)) > 1e-16)
+					return false;
+		}
+		return true;
+	};
+	for(int64_t remaining = days; remaining; remaining >>= 1)
 	{
-		while(line[pos] <= ' ')
-			++pos;
+		if(remaining & 1)
+			combine(transition, covariance, power, powerNoise);
+		if(remaining > 1)
+		{
+			// Squaring can be done in place, since combine() only overwrites
+			// each of its outputs once it is done reading the matching input.
+			combine(power, powerNoise, power, powerNoise);
+			if(isSettled())
+			{
+				combine(transition, covariance, power, powerNoise);
+				break;
+			}
+		}
+	}
 
-		char quote = 0;
-		if(line[pos] == '"' || line[pos] == '`')
-			quote = line[pos++];
-		size_t start = pos;
-		while(pos < line.length() && (quote ? (line[pos] != quote) : (line[pos] > ' ')))
-			++pos;
+	// The working matrices are not needed any more, so free them before making
+	// another one.
+	vector<double>().swap(power);
+	vector<double>().swap(powerNoise);
+	vector<double>().swap(product);
+	vector<double>().swap(scratch);
 
-		if(!index--)
-			return line.substr(start, pos - start);
-		pos = pos + !!quote;
+	// Factor the covariance (Cholesky decomposition). Systems that are not part
+	// of the economy have no variance at all, and the results may be slightly
+	// off from being positive definite due to rounding, so skip any column
+	// whose pivot is too small.
+	noise.assign(area, 0.);
+	double largest = 0.;
+	for(int i = 0; i < size; ++i)
+		largest = max(largest, covariance[static_cast<size_t>(i) * size + i]);
+	const double EPSILON = largest * 1e-12;
+	for(int j = 0; j < size; ++j)
+	{
+		double *rowJ = noise.data() + static_cast<size_t>(j) * size;
+		double pivot = covariance[static_cast<size_t>(j) * size + j];
+		for(int k = 0; k < j; ++k)
+			pivot -= rowJ[k] * rowJ[k];
+		if(pivot <= EPSILON)
+			continue;
+		rowJ[j] = sqrt(pivot);
+		auto column = [&](int first, int last)
+		{
+			for(int i = max(first, j + 1); i < last; ++i)
+			{
+				double *rowI = noise.data() + static_cast<size_t>(i) * size;
+				double sum = covariance[static_cast<size_t>(i) * size + j];
+				for(int k = 0; k < j; ++k)
+					sum -= rowI[k] * rowJ[k];
+				rowI[j] = sum / rowJ[j];
+			}
+		};
+		if(pool && pool->Size() > 1 && size - j > 256)
+			pool->ForEach(j + 1, size, column);
+		else
+			column(j + 1, size);
 	}
-	return "";
 }
 
-double Value(const string &line, int index)
+
+
+int64_t FastForward::Days() const
 {
-	double value = 0.;
-	istringstream(Token(line, index)) >> value;
-	return value;
+	return days;
 }
 
-double MapColor(double value, double *r, double *g, double *b)
+
+
+int FastForward::Size() const
 {
-	value = min(1., max(-1., value));
-	if(value < 0.)
+	return size;
+}
+
+
+
+const double *FastForward::Transition(int lane, int system) const
+{
+	return transition[lane].data() + static_cast<size_t>(system) * size;
+}
+
+
+
+const double *FastForward::Noise(int lane, int system) const
+{
+	return noise[lane].data() + static_cast<size_t>(system) * size;
+}
+
+
+
+Ziggurat::Ziggurat()
+{
+	// The start of the tail of the curve, and the area of each layer, for a
+	// curve scaled so that its peak is at 1.
+	const double TAIL = 3.442619855899;
+	const double AREA = 9.91256303526217e-3;
+	const double TAIL_HEIGHT = exp(-.5 * TAIL * TAIL);
+
+	// The bottom layer includes the tail, so it is treated as if it were a
+	// rectangle that is wider than the others.
+	edge[0] = AREA / TAIL_HEIGHT;
+	edge[1] = TAIL;
+	edge[LAYERS] = 0.;
+	for(int i = 2; i < LAYERS; ++i)
+		edge[i] = sqrt(-2. * log(AREA / edge[i - 1] + exp(-.5 * edge[i - 1] * edge[i - 1])));
+	for(int i = 0; i < LAYERS; ++i)
+		inside[i] = edge[i + 1] / edge[i];
+}
+
+
+
+double Ziggurat::Normal(uint64_t bits) const
+{
+	// Pick a layer, and a point in it from -1 to 1 times its width. Keep this
+	// part short enough to be inlined into the simulation's inner loop.
+	int layer = bits & (LAYERS - 1);
+	double u = 2. * Uniform(bits) - 1.;
+	if(fabs(u) < inside[layer])
+		return u * edge[layer];
+	return Retry(bits);
+}
+
+
+
+double Ziggurat::Retry(uint64_t bits) const
+{
+	const double TAIL = 3.442619855899;
+	while(true)
 	{
-		*r = 0.;
-		*g = 50. * -value;
-		*b = 100. * -value;
+		int layer = bits & (LAYERS - 1);
+		double u = 2. * Uniform(bits) - 1.;
+		if(fabs(u) < inside[layer])
+			return u * edge[layer];
+
+		if(!layer)
+		{
+			// Pick a point in the tail.
+			while(true)
+			{
+				bits = Mix(bits);
+				double x = log(Uniform(bits)) / TAIL;
+				bits = Mix(bits);
+				double y = log(Uniform(bits));
+				if(-2. * y >= x * x)
+					return (u < 0.) ? x - TAIL : TAIL - x;
+			}
+		}
+
+		// The point is in the part of the layer that sticks out past the layer
+		// above it, so check whether it is under the curve.
+		double x = u * edge[layer];
+		double f0 = exp(-.5 * (edge[layer] * edge[layer] - x * x));
+		double f1 = exp(-.5 * (edge[layer + 1] * edge[layer + 1] - x * x));
+		bits = Mix(bits);
+		if(f1 + Uniform(bits) * (f0 - f1) < 1.)
+			return x;
+		bits = Mix(bits);
+	}
+}
+
+
+
+bool SeriesWriter::Open(const string &path, bool csv, const SystemGraph &graph, const vector<string> &commodities,
+	int interval, uint64_t seed)
+{
+	this->csv = csv;
+	out.open(path, csv ? ios::out : ios::out | ios::binary);
+	if(!out)
+		return false;
+
+	if(csv)
+	{
+		// Write as many digits as the binary format keeps.
+		out.precision(9);
+		out << "day";
+		for(int i = 0; i < graph.Size(); ++i)
+			for(const string &commodity : commodities)
+				out << ',' << Quote(commodities.size() > 1 ? graph.Name(i) + ": " + commodity : graph.Name(i));
+		out << '\n';
 	}
 	else
 	{
-		*r = 100. * value;
-		*g = 50. * value;
-		*b = 0.;
+		const uint32_t VERSION = 2;
+		uint32_t systems = graph.Size();
+		uint32_t lanes = commodities.size();
+		uint32_t sampleInterval = interval;
+		out.write("ESTS", 4);
+		out.write(reinterpret_cast<const char *>(&VERSION), sizeof(VERSION));
+		out.write(reinterpret_cast<const char *>(&systems), sizeof(systems));
+		out.write(reinterpret_cast<const char *>(&lanes), sizeof(lanes));
+		out.write(reinterpret_cast<const char *>(&sampleInterval), sizeof(sampleInterval));
+		out.write(reinterpret_cast<const char *>(&seed), sizeof(seed));
+		for(int i = 0; i < graph.Size(); ++i)
+			out.write(graph.Name(i).c_str(), graph.Name(i).length() + 1);
+		for(const string &commodity : commodities)
+			out.write(commodity.c_str(), commodity.length() + 1);
+		buffer.resize(static_cast<size_t>(systems) * lanes);
 	}
+	return static_cast<bool>(out);
 }
 
 
 
-int main(int argc, char *argv[])
+void SeriesWriter::Write(int64_t day, const vector<double> &supply)
 {
-	if(argc < 2)
-		return 1;
+	if(csv)
+	{
+		out << day;
+		for(double value : supply)
+			out << ',' << value;
+		out << '\n';
+		return;
+	}
 
-	mt19937_64 gen;
-	gen.seed(12345);
-	normal_distribution<double> normal;
+	for(size_t i = 0; i < supply.size(); ++i)
+		buffer[i] = supply[i];
+	out.write(reinterpret_cast<const char *>(&day), sizeof(day));
+	out.write(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(float));
+}
 
-	map<string, double> posX;
-	map<string, double> posY;
-	map<string, set<string>> links;
 
-	double minX = 0.;
-	double maxX = 0.;
-	double minY = 0.;
-	double maxY = 0.;
 
-	string line;
-	string name;
+Checkpoint::~Checkpoint()
+{
+#if defined __linux__
+	if(isMapped)
+		munmap(const_cast<char *>(data), size);
+#endif
+}
+
+
+
+bool Checkpoint::Load(const string &path)
+{
+#if defined __linux__
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat info;
+	if(!fstat(fd, &info) && info.st_size > 0)
+	{
+		void *mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(mapped != MAP_FAILED)
+		{
+			data = static_cast<const char *>(mapped);
+			size = info.st_size;
+			isMapped = true;
+		}
+	}
+	close(fd);
+#endif
+	if(!isMapped)
+	{
+		ifstream in(path, ios::binary);
+		if(!in)
+			return false;
+		buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+		data = buffer.data();
+		size = buffer.size();
+	}
+
+	if(size < sizeof(Header))
+		return false;
+	const Header &header = Info();
+	return !memcmp(header.magic, "ESCP", 4) && header.version == 1
+		&& size == sizeof(Header) + static_cast<size_t>(header.systems) * header.lanes * sizeof(double);
+}
+
+
+
+const Checkpoint::Header &Checkpoint::Info() const
+{
+	return *reinterpret_cast<const Header *>(data);
+}
+
+
+
+const double *Checkpoint::Supply() const
+{
+	return reinterpret_cast<const double *>(data + sizeof(Header));
+}
+
+
+
+Statistics::Statistics(int size)
+	: size(size), mean(size), squares(size), histogram(static_cast<size_t>(size) * BINS)
+{
+}
+
+
+
+void Statistics::Add(const vector<double> &values)
+{
+	++count;
+	for(int i = 0; i < size; ++i)
+	{
+		double delta = values[i] - mean[i];
+		mean[i] += delta / count;
+		squares[i] += delta * (values[i] - mean[i]);
+
+		int bin = (values[i] + 1.) * (BINS / 2);
+		++histogram[static_cast<size_t>(i) * BINS + max(0, min(BINS - 1, bin))];
+	}
+}
+
+
+
+void Statistics::Merge(const Statistics &other)
+{
+	if(!other.count)
+		return;
 
-	ifstream in(argv[1]);
-	while(getline(in, line))
+	int64_t total = count + other.count;
+	for(int i = 0; i < size; ++i)
 	{
-		if(StartsWith(line, "system"))
-			name = Token(line, 1);
-		else if(StartsWith(line, "\tpos") && !name.empty())
+		double delta = other.mean[i] - mean[i];
+		mean[i] += delta * other.count / total;
+		squares[i] += other.squares[i] + delta * delta * count * other.count / total;
+	}
+	for(size_t i = 0; i < histogram.size(); ++i)
+		histogram[i] += other.histogram[i];
+	count = total;
+}
+
+
+
+int64_t Statistics::Count() const
+{
+	return count;
+}
+
+
+
+double Statistics::Mean(int index) const
+{
+	return mean[index];
+}
+
+
+
+double Statistics::Variance(int index) const
+{
+	return (count > 1) ? squares[index] / (count - 1) : 0.;
+}
+
+
+
+// Find the bin that the quantile falls in, and assume the samples in that bin
+// are spread evenly across it.
+double Statistics::Quantile(int index, double fraction) const
+{
+	const uint32_t *bins = histogram.data() + static_cast<size_t>(index) * BINS;
+	double target = fraction * count;
+	double below = 0.;
+	for(int bin = 0; bin < BINS; ++bin)
+	{
+		if(bins[bin] && below + bins[bin] >= target)
+			return -1. + (bin + (target - below) / bins[bin]) * (2. / BINS);
+		below += bins[bin];
+	}
+	return 1.;
+}
+
+
+
+// Multiply two square matrices, stored row by row. Each thread works on a
+// different set of rows of the result.
+void Multiply(const vector<double> &a, const vector<double> &b, vector<double> &result, int size,
+	ThreadPool *pool)
+{
+	auto rows = [&](int first, int last)
+	{
+		for(int i = first; i < last; ++i)
+		{
+			double *out = result.data() + static_cast<size_t>(i) * size;
+			fill(out, out + size, 0.);
+			for(int k = 0; k < size; ++k)
+			{
+				double scale = a[static_cast<size_t>(i) * size + k];
+				if(!scale)
+					continue;
+				const double *in = b.data() + static_cast<size_t>(k) * size;
+				for(int j = 0; j < size; ++j)
+					out[j] += scale * in[j];
+			}
+		}
+	};
+	if(pool && pool->Size() > 1)
+		pool->ForEach(0, size, rows);
+	else
+		rows(0, size);
+}
+
+
+
+// Multiply a square matrix by the transpose of another. Each entry of the result
+// is the dot product of a row of each, so this never has to read down a column.
+void MultiplyTransposed(const vector<double> &a, const vector<double> &b, vector<double> &result, int size,
+	ThreadPool *pool)
+{
+	auto rows = [&](int first, int last)
+	{
+		for(int i = first; i < last; ++i)
+		{
+			const double *left = a.data() + static_cast<size_t>(i) * size;
+			for(int j = 0; j < size; ++j)
+			{
+				const double *right = b.data() + static_cast<size_t>(j) * size;
+				double sum = 0.;
+				for(int k = 0; k < size; ++k)
+					sum += left[k] * right[k];
+				result[static_cast<size_t>(i) * size + j] = sum;
+			}
+		}
+	};
+	if(pool && pool->Size() > 1)
+		pool->ForEach(0, size, rows);
+	else
+		rows(0, size);
+}
+
+
+
+// Get how much memory this computer has. If that cannot be found out, assume a
+// modest amount.
+double PhysicalMemory()
+{
+#if defined __linux__
+	const long pages = sysconf(_SC_PHYS_PAGES);
+	const long pageSize = sysconf(_SC_PAGE_SIZE);
+	if(pages > 0 && pageSize > 0)
+		return static_cast<double>(pages) * pageSize;
+#endif
+	return 8. * 1024. * 1024. * 1024.;
+}
+
+
+
+// Scramble the bits of a 64-bit number (the "splitmix64" finalizer).
+uint64_t Mix(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+
+
+// Turn the upper 53 bits of a random number into a uniformly distributed number
+// that is greater than zero and no more than one.
+double Uniform(uint64_t bits)
+{
+	return ((bits >> 11) + 1) * (1. / 9007199254740992.);
+}
+
+
+
+// Get a hash of the names and links of every system in the map.
+uint64_t GraphHash(const SystemGraph &graph)
+{
+	uint64_t hash = Mix(graph.Size());
+	for(int i = 0; i < graph.Size(); ++i)
+	{
+		for(unsigned char c : graph.Name(i))
+			hash = Mix(hash ^ c);
+		hash = Mix(hash ^ graph.Degree(i));
+		for(int j : graph.Links(i))
+			hash = Mix(hash ^ j);
+	}
+	return hash;
+}
+
+
+
+// Get a hash of the exact values of every commodity's parameters.
+uint64_t ParameterHash(const vector<Parameters> &parameters)
+{
+	uint64_t hash = Mix(parameters.size());
+	for(const Parameters &lane : parameters)
+		for(double value : {lane.trade, lane.keep, lane.volume, lane.limit})
 		{
-			double x = Value(line, 1);
-			double y = Value(line, 2);
-			minX = min(minX, x);
-			maxX = max(maxX, x);
-			minY = min(minY, y);
-			maxY = max(maxY, y);
-			posX[name] = x;
-			posY[name] = y;
+			uint64_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+			hash = Mix(hash ^ bits);
 		}
-		else if(StartsWith(line, "\tlink") && !name.empty())
-			links[name].insert(Token(line, 1));
+	return hash;
+}
+
+
+
+// Draw the map, coloring each system according to the given value between -1
+// and 1, and save it as an SVG.
+void DrawMap(const SystemGraph &graph, const vector<double> &values, const string &path)
+{
+	double minX = 0.;
+	double maxX = 0.;
+	double minY = 0.;
+	double maxY = 0.;
+	for(int i = 0; i < graph.Size(); ++i)
+	{
+		minX = min(minX, graph.X(i));
+		maxX = max(maxX, graph.X(i));
+		minY = min(minY, graph.Y(i));
+		maxY = max(maxY, graph.Y(i));
 	}
 
 	// Add a slight border around the edges.
@@ -140,85 +1872,118 @@ int main(int argc, char *argv[])
 	int width = scale * (maxX - minX);
 	int height = scale * (maxY - minY);
 
-	// Run the simulation repeatedly.
-	map<string, double> supply;
-	map<string, double> trade;
-	int DAYS = 1000;
-	while(true)
+	if(path.size() >= 4 && !path.compare(path.size() - 4, 4, ".png"))
 	{
-		static const double TRADE = .10;
-		static const double KEEP = .89;
-		static const double VOLUME = 10000.;
-		static const double LIMIT = 100000.;
-		for(int day = 0; day < DAYS; ++day)
+		Image image(max(1, width), max(1, height));
+		Raster raster(image, minX, minY, scale);
+		raster.Fill(Raster::Color(0., 0., 0.));
+		const uint32_t LINK_COLOR = Raster::Color(.27, .27, .27);
+		for(int i = 0; i < graph.Size(); ++i)
+			for(int link : graph.Links(i))
+				if(graph.Name(link) > graph.Name(i))
+					raster.Line(graph.X(i), graph.Y(i), graph.X(link), graph.Y(link), 1.5, LINK_COLOR);
+		for(int i = 0; i < graph.Size(); ++i)
 		{
-			for(const auto &it : links)
-			{
-				trade[it.first] = TRADE * supply[it.first];
-				supply[it.first] *= KEEP;
-				supply[it.first] += normal(gen) * VOLUME;
-			}
-			for(const auto &it : links)
-				if(it.second.size())
-				{
-					double share = trade[it.first] / it.second.size();
-					for(const string &link : it.second)
-						supply[link] += share;
-				}
+			double r, g, b;
+			MapColor(values[i], &r, &g, &b);
+			raster.Circle(graph.X(i), graph.Y(i), RADIUS, Raster::Color(r / 100., g / 100., b / 100.));
 		}
-		// After the first day, step according to the given step size.
-		if(argc > 2)
-			DAYS = stoi(argv[2]);
+		image.Write(path, 6);
+		return;
+	}
 
-		ofstream out("economy.svg");
-		out << "<svg width=\"" << width << "\" height=\"" << height << "\">" << endl;
-		out << "<rect width=\"" << width << "\" height=\"" << height << "\" fill=\"black\" />" << endl;
+	SvgWriter out(path);
+	out.Begin(width, height);
+	out.Rect(0., 0., width, height, "fill=\"black\"");
 
-		// Draw the links.
-		for(const auto &it : posX)
+	// Draw the links.
+	for(int i = 0; i < graph.Size(); ++i)
+	{
+		double x1 = (graph.X(i) - minX) * scale;
+		double y1 = (graph.Y(i) - minY) * scale;
+		for(int link : graph.Links(i))
 		{
-			string system = it.first;
-			double x1 = (posX[system] - minX) * scale;
-			double y1 = (posY[system] - minY) * scale;
-			for(const string &link : links[system])
-			{
-				// Only draw links in one direction.
-				if(link <= system)
-					continue;
-				double x2 = (posX[link] - minX) * scale;
-				double y2 = (posY[link] - minY) * scale;
-
-				out << "<line x1=\"" << x1 << "\" y1=\"" << y1 << "\" x2=\"" << x2 << "\" y2=\"" << y2
-					<< "\" style=\"stroke:#444444;stroke-width:1.5\" />" << endl;
-			}
+			// Only draw links in one direction.
+			if(graph.Name(link) <= graph.Name(i))
+				continue;
+			double x2 = (graph.X(link) - minX) * scale;
+			double y2 = (graph.Y(link) - minY) * scale;
+			out.Line(x1, y1, x2, y2, "stroke=\"#444\" stroke-width=\"1.5\"");
 		}
+	}
 
-		// Draw circles for the systems.
-		double lowest = 1.;
-		double highest = -1.;
-		for(const auto &it : posX)
-		{
-			string system = it.first;
-			double x = (posX[system] - minX) * scale;
-			double y = (posY[system] - minY) * scale;
-			double value = erf(supply[it.first] / LIMIT);
-			lowest = min(value, lowest);
-			highest = max(value, highest);
-			double r, g, b;
-			MapColor(value, &r, &g, &b);
+	// Draw circles for the systems.
+	for(int i = 0; i < graph.Size(); ++i)
+	{
+		double x = (graph.X(i) - minX) * scale;
+		double y = (graph.Y(i) - minY) * scale;
+		double r, g, b;
+		MapColor(values[i], &r, &g, &b);
+		out.Circle(x, y, RADIUS, "fill=\"" + SvgWriter::Color(r / 100., g / 100., b / 100.) + "\"");
+	}
+	out.Close();
+}
 
-			out << "<circle cx=\"" << x << "\" cy=\"" << y << "\" r=\"" << RADIUS
-				<< "\" fill=\"rgb(" << r << "%, " << g << "%, " << b << "%)\" />" << endl;
-		}
 
-		out << "</svg>" << endl;
-		out.close();
 
-		cout << "Adjustment range: " << lowest << " to " << highest;
-		cin.get();
-		if(!cin)
-			break;
+void MapColor(double value, double *r, double *g, double *b)
+{
+	value = min(1., max(-1., value));
+	if(value < 0.)
+	{
+		*r = 0.;
+		*g = 50. * -value;
+		*b = 100. * -value;
 	}
-	cout << endl;
-	return 0;
+	else
+	{
+		*r = 100. * value;
+		*g = 50. * value;
+		*b = 0.;
+	}
+}
+
+
+
+void PrintHelp()
+{
+	cerr << endl;
+	cerr << "Usage: $ dynamic-economy [--threads <count>] [--seed <seed>] <map> [days]" << endl;
+	cerr << "   Simulates 1000 days, then another [days] (default 1000) each time you press enter," << endl;
+	cerr << "   drawing the result to economy.svg." << endl;
+	cerr << "Or: $ dynamic-economy [options] --days <count> [--sample <days>] --output <file> [--csv] <map>" << endl;
+	cerr << "   Simulates the given number of days without stopping, and writes the supply in" << endl;
+	cerr << "   every system every <days> days (default 1) to the given file." << endl;
+	cerr << "Or: $ dynamic-economy [options] --ensemble <runs> --days <count> [--burn-in <days>]"
+		" [--sample <days>] --output <name> <map>" << endl;
+	cerr << "   Runs the simulation with <runs> different seeds, and writes statistics of each" << endl;
+	cerr << "   system's price adjustment after the burn-in (default 1000 days) to <name>.csv," << endl;
+	cerr << "   and a map of the average adjustment to <name>.svg." << endl;
+	cerr << "Or: $ dynamic-economy [options] --days <count> [--burn-in <days>] [--sample <days>]"
+		" --output <file> <map>" << endl;
+	cerr << "   with a list or range of values for at least one parameter: simulates every" << endl;
+	cerr << "   combination, and writes a summary of each one to the given file." << endl;
+	cerr << "   --threads: how many threads to simulate with (default: one per core). The result" << endl;
+	cerr << "      is exactly the same for any number of threads." << endl;
+	cerr << "   --seed: the random seed to use (default 12345)." << endl;
+	cerr << "   --csv: write the samples as text instead of in a compact binary format." << endl;
+	cerr << "   --png: draw maps as PNG images instead of SVG files." << endl;
+	cerr << "   --svgz: draw maps as compressed SVG files." << endl;
+	cerr << "   --trade, --keep, --volume, --limit: the simulation parameters (default 0.1, 0.89," << endl;
+	cerr << "      10000, and 100000). Each can be a value, a list of values separated by commas," << endl;
+	cerr << "      or a range of values like 0.05:0.15:11 (start, end, and number of values)." << endl;
+	cerr << "   --fast-forward: jump this many days ahead before starting, which is much faster" << endl;
+	cerr << "      than simulating every day on maps of up to a few thousand systems. If that would" << endl;
+	cerr << "      take more than three quarters of the computer's memory, nothing is run." << endl;
+	cerr << "   --burn-in: the day on which an ensemble or sweep starts taking samples." << endl;
+	cerr << "   --commodity: simulate the commodity in the given file, or all the ones in the given" << endl;
+	cerr << "      directory, all at once. A commodity file gives its \"name\", and may give its own" << endl;
+	cerr << "      \"trade\", \"keep\", \"volume\" and \"limit\"; the options above override them." << endl;
+	cerr << "   --checkpoint <file>: save the state of the simulation to the given file at the end" << endl;
+	cerr << "      of the run, or after each step in interactive mode." << endl;
+	cerr << "   --checkpoint-every <days>: also save it at the first sample after each <days> days." << endl;
+	cerr << "   --resume <file>: start from a saved state. Without --seed, the run continues" << endl;
+	cerr << "      exactly where it left off; with a different seed, it branches off from there." << endl;
+	cerr << "      Days are still counted from the start of the original run." << endl;
+	cerr << endl;
 }
@@ -14,219 +14,1011 @@ this program. If not, see <https://www.gnu.org/licenses/>.
 */
 
 // Program for generating a map of the galaxy, colored by government.
-// $ g++ --std=c++11 -o mapper mapper.cpp
+// $ g++ --std=c++17 -O2 -pthread -o mapper mapper.cpp -lpng -lz
 // $ ./mapper path/to/map.txt path/to/governments.txt > map.svg
+// To color the systems by the price of one commodity instead, give the file
+// that lists the price range of each commodity, and the commodity's name:
+// $ ./mapper path/to/map.txt path/to/commodities.txt <commodity> > map.svg
+// $ ./mapper [--threads <count>] --output <directory> path/to/map.txt <data file>...
+// With --output, every file is parsed once, and a map is drawn for each layer
+// they contain: the governments, the price of each commodity, each numeric
+// attribute that systems have (like "habitable"), and the number of links each
+// system has. The layers are drawn in parallel, each to its own file in the
+// given directory. With --svgz, those files are compressed.
+// With --png, the layers are drawn as PNG images instead, by a built-in
+// anti-aliased rasterizer; --size sets their width or height, whichever is
+// larger. With --tiles <levels>, each layer is instead cut into a "pyramid" of
+// 256 by 256 pixel tiles at that many zoom levels, like the maps on the web use:
+// at level z, the map is 2^z tiles across, and the tile in column x and row y is
+// <layer>/<z>/<x>/<y>.png. Huge maps can then be explored smoothly by only ever
+// loading the few tiles that are on the screen. All the tiles are drawn in
+// parallel.
+// With --region <left>,<top>,<right>,<bottom>, only that rectangle of the map
+// (in map coordinates) is drawn, filling the whole picture. Only the systems and
+// links that are in view are looked at when drawing, so a small region of a huge
+// map is quick to draw and makes a small file.
+// With --lod, systems that are so close together that their dots would overlap
+// are grouped into the cells of a quadtree, and each group is drawn as a single
+// dot, colored by the government most of them belong to or by the average of
+// their values. The cells are chosen separately for each image or zoom level,
+// so that the work of drawing a zoomed-out map depends on the number of pixels,
+// not the number of systems.
 
-#include <fstream>
+#include "shared/DataFile.cpp"
+#include "shared/DataNode.cpp"
+#include "shared/Image.cpp"
+#include "shared/Raster.cpp"
+#include "shared/SpatialIndex.cpp"
+#include "shared/SvgWriter.cpp"
+#include "shared/ThreadPool.cpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
 #include <map>
 #include <set>
-#include <sstream>
 #include <string>
+#include <vector>
 
 using namespace std;
 
-bool StartsWith(const string &line, const string &str)
+// With --lod, the size in pixels of the smallest group of systems to draw as one
+// dot. This is the width of a dot.
+const double LOD_SIZE = 4.;
+
+// A color, with each component given as a percentage.
+class Rgb {
+public:
+	double r = 100.;
+	double g = 100.;
+	double b = 100.;
+};
+
+class System {
+public:
+	bool hasPosition = false;
+	double x = 0.;
+	double y = 0.;
+	string government;
+	set<string> links;
+	// The price of each commodity.
+	map<string, double> trade;
+	// Any other numeric value given for this system, like "habitable".
+	map<string, double> attributes;
+};
+
+// The price range of a commodity, used to scale its prices to colors.
+class Commodity {
+public:
+	string name;
+	double low = 0.;
+	double high = 2000.;
+};
+
+// Everything needed to draw any of the maps. Each data file only has to be
+// parsed once, and may contain any mix of systems, governments and commodities.
+class Galaxy {
+public:
+	void Load(const DataFile &file);
+	// Drop systems that have no position, and figure out how to fit the rest
+	// into the picture. If a region is given (left, top, right, bottom), fit
+	// that part of the map into the picture instead.
+	void Finish(const vector<double> &region);
+
+	// Convert map coordinates to picture coordinates.
+	double X(double x) const;
+	double Y(double y) const;
+
+	map<string, System> systems;
+	map<string, Rgb> governments;
+	vector<Commodity> commodities;
+	// Attributes that have a single numeric value in every system that has them.
+	set<string> attributes;
+
+	int width = 0;
+	int height = 0;
+
+
+private:
+	// Attributes that are not always given as a single number.
+	set<string> otherAttributes;
+
+	double minX = 0.;
+	double minY = 0.;
+	double scale = 1.;
+};
+
+// One map to draw: the color of each system. Systems with no color are drawn in
+// gray. If the colors stand for values, the values are kept too, from 0 to 1, so
+// that groups of systems can be colored by their average.
+class Layer {
+public:
+	string name;
+	map<string, Rgb> colors;
+	map<string, double> values;
+};
+
+// The shapes that make up the map, in picture coordinates, so that they can be
+// drawn any number of times without looking up any systems by name.
+class Scene {
+public:
+	explicit Scene(const Galaxy &galaxy);
+
+	// Make a simpler version of this scene, in which the points in each cell of
+	// a quadtree are merged into one point at their center. The cells are the
+	// smallest ones that are at least the given size.
+	Scene Simplify(double cellSize) const;
+
+	// The color of each system in the given layer, in the same order as the
+	// points.
+	vector<uint32_t> Colors(const Galaxy &galaxy, const Layer &layer) const;
+	// Draw the parts of the map that are within the given rectangle, which
+	// should include a margin for the size of the dots.
+	void Paint(Raster &raster, const vector<uint32_t> &colors,
+		double left, double top, double right, double bottom) const;
+	bool Write(SvgWriter &out, const vector<uint32_t> &colors) const;
+
+	int width;
+	int height;
+	// The two ends of each link, and the center of each system.
+	vector<double> lines;
+	vector<double> points;
+
+
+private:
+	Scene(int width, int height);
+	// Index the points and lines, once they have all been added.
+	void Finish();
+
+	// Find the links and systems that may be within the given rectangle.
+	vector<int> VisibleLinks(double left, double top, double right, double bottom) const;
+	vector<int> VisibleSystems(double left, double top, double right, double bottom) const;
+
+
+private:
+	// The systems that each point stands for are members[offsets[i]] to
+	// members[offsets[i + 1] - 1], numbered in the order the galaxy lists them.
+	vector<int> offsets;
+	vector<int> members;
+	// The points at the two ends of each link.
+	vector<int> ends;
+
+	// The quadtree is stored implicitly: each point's code interleaves the bits
+	// of its x and y coordinates, so sorting the points by their codes puts the
+	// points of every cell, at every level of the tree, next to each other.
+	vector<uint32_t> codes;
+	vector<int> order;
+	double extent = 0.;
+
+	SpatialIndex systemIndex;
+	// Links are found by their midpoints. Any link that crosses a rectangle has
+	// its midpoint within half the length of the longest link of that rectangle.
+	SpatialIndex linkIndex;
+	double linkReach = 0.;
+};
+
+class Options {
+public:
+	int threads = 1;
+	string outputPath;
+	bool png = false;
+	bool svgz = false;
+	int size = 0;
+	int tileLevels = 0;
+	bool lod = false;
+	// The part of the map to draw, if not all of it.
+	vector<double> region;
+};
+
+Layer GovernmentLayer(const Galaxy &galaxy);
+Layer TradeLayer(const Galaxy &galaxy, const Commodity &commodity);
+Layer AttributeLayer(const string &name, const map<string, double> &values);
+vector<Layer> AllLayers(const Galaxy &galaxy);
+int DrawImages(const Galaxy &galaxy, const vector<Layer> &layers, const Options &options);
+string FileName(const string &name);
+bool IsNumber(const string &token);
+bool ParseRegion(const char *text, vector<double> &region);
+Rgb Color(double value);
+void PrintHelp();
+
+
+
+int main(int, char *argv[])
 {
-	return line.length() >= str.length() && !line.compare(0, str.length(), str);
+	Options options;
+	options.threads = ThreadPool::DefaultSize();
+	vector<string> args;
+	for(char **it = argv + 1; *it; ++it)
+	{
+		if(!strcmp(*it, "--threads") && it[1])
+			options.threads = max(1, atoi(*++it));
+		else if(!strcmp(*it, "--output") && it[1])
+			options.outputPath = *++it;
+		else if(!strcmp(*it, "--png"))
+			options.png = true;
+		else if(!strcmp(*it, "--svgz"))
+			options.svgz = true;
+		else if(!strcmp(*it, "--size") && it[1])
+			options.size = max(1, atoi(*++it));
+		else if(!strcmp(*it, "--tiles") && it[1])
+			options.tileLevels = max(1, atoi(*++it));
+		else if(!strcmp(*it, "--lod"))
+			options.lod = true;
+		else if(!strcmp(*it, "--region") && it[1])
+		{
+			if(!ParseRegion(*++it, options.region))
+			{
+				cerr << "Invalid region: " << *it << endl;
+				return 1;
+			}
+		}
+		else if(!strcmp(*it, "-h") || !strcmp(*it, "--help"))
+		{
+			PrintHelp();
+			return 0;
+		}
+		else
+			args.push_back(*it);
+	}
+	if(args.empty() || ((options.png || options.tileLevels) && options.outputPath.empty()))
+	{
+		PrintHelp();
+		return 1;
+	}
+
+	Galaxy galaxy;
+	const string &outputPath = options.outputPath;
+	if(outputPath.empty())
+	{
+		// Draw a single map to the standard output, either of the governments or
+		// of the price of one commodity.
+		galaxy.Load(DataFile(args[0]));
+		if(args.size() > 1)
+			galaxy.Load(DataFile(args[1]));
+		galaxy.Finish(options.region);
+
+		Layer layer;
+		if(args.size() > 2)
+		{
+			Commodity commodity;
+			commodity.name = args[2];
+			for(const Commodity &it : galaxy.commodities)
+				if(it.name == commodity.name)
+					commodity = it;
+			layer = TradeLayer(galaxy, commodity);
+		}
+		else
+			layer = GovernmentLayer(galaxy);
+		for(const auto &it : galaxy.systems)
+			if(!layer.colors.count(it.first))
+				cerr << it.first << endl;
+
+		Scene scene(galaxy);
+		if(options.lod)
+			scene = scene.Simplify(LOD_SIZE);
+		SvgWriter out(cout);
+		return scene.Write(out, scene.Colors(galaxy, layer)) ? 0 : 1;
+	}
+
+	for(const string &path : args)
+		galaxy.Load(DataFile(path));
+	galaxy.Finish(options.region);
+
+	error_code error;
+	filesystem::create_directories(outputPath, error);
+	vector<Layer> layers = AllLayers(galaxy);
+	if(options.png || options.tileLevels)
+		return DrawImages(galaxy, layers, options);
+
+	// The positions of the systems and links are the same in every layer.
+	Scene scene(galaxy);
+	if(options.lod)
+		scene = scene.Simplify(LOD_SIZE);
+	vector<char> failed(layers.size());
+	ThreadPool pool(min<int>(options.threads, layers.size()));
+	pool.ForEach(0, layers.size(), [&](int first, int last)
+	{
+		for(int i = first; i < last; ++i)
+		{
+			string name = FileName(layers[i].name) + (options.svgz ? ".svgz" : ".svg");
+			SvgWriter out((filesystem::path(outputPath) / name).string());
+			failed[i] = !scene.Write(out, scene.Colors(galaxy, layers[i]));
+		}
+	});
+
+	int written = 0;
+	for(size_t i = 0; i < layers.size(); ++i)
+	{
+		if(failed[i])
+			cerr << "Unable to write the map of " << layers[i].name << "." << endl;
+		else
+			++written;
+	}
+	cout << "Drew " << written << " maps in " << outputPath << "." << endl;
+	return (written == static_cast<int>(layers.size())) ? 0 : 1;
 }
 
-string Token(const string &line, int index)
+
+
+void Galaxy::Load(const DataFile &file)
 {
-	size_t pos = 0;
+	for(const DataNode &node : file)
+	{
+		if(node.Token(0) == "system" && node.Size() >= 2)
+		{
+			System &system = systems[node.Token(1)];
+			for(const DataNode &child : node)
+			{
+				const string &key = child.Token(0);
+				if(key == "pos" && child.Size() >= 3)
+				{
+					system.hasPosition = true;
+					system.x = child.Value(1);
+					system.y = child.Value(2);
+				}
+				else if(key == "government" && child.Size() >= 2)
+					system.government = child.Token(1);
+				else if(key == "link" && child.Size() >= 2)
+					system.links.insert(child.Token(1));
+				else if(key == "trade" && child.Size() >= 3)
+					system.trade[child.Token(1)] = child.Value(2);
+				else if(child.Size() == 2 && IsNumber(child.Token(1)))
+				{
+					system.attributes[key] = child.Value(1);
+					if(!otherAttributes.count(key))
+						attributes.insert(key);
+				}
+				else
+				{
+					attributes.erase(key);
+					otherAttributes.insert(key);
+				}
+			}
+		}
+		else if(node.Token(0) == "government" && node.Size() >= 2)
+		{
+			for(const DataNode &child : node)
+				if(child.Token(0) == "color" && child.Size() >= 4)
+				{
+					Rgb &color = governments[node.Token(1)];
+					color.r = 100. * child.Value(1);
+					color.g = 100. * child.Value(2);
+					color.b = 100. * child.Value(3);
+				}
+		}
+		else if(node.Token(0) == "trade")
+		{
+			for(const DataNode &child : node)
+				if(child.Token(0) == "commodity" && child.Size() >= 4)
+				{
+					auto it = find_if(commodities.begin(), commodities.end(),
+						[&child](const Commodity &commodity) { return commodity.name == child.Token(1); });
+					if(it == commodities.end())
+						it = commodities.insert(it, Commodity());
+					it->name = child.Token(1);
+					it->low = child.Value(2);
+					it->high = child.Value(3);
+				}
+		}
+	}
+}
+
 
-	while(pos < line.length())
+
+void Galaxy::Finish(const vector<double> &region)
+{
+	for(auto it = systems.begin(); it != systems.end(); )
 	{
-		while(line[pos] <= ' ')
-			++pos;
+		if(it->second.hasPosition)
+			++it;
+		else
+			it = systems.erase(it);
+	}
 
-		char quote = 0;
-		if(line[pos] == '"' || line[pos] == '`')
-			quote = line[pos++];
-		size_t start = pos;
-		while(pos < line.length() && (quote ? (line[pos] != quote) : (line[pos] > ' ')))
-			++pos;
+	const double MAX_DIMENSION = 600.;
+	if(region.size() == 4)
+	{
+		minX = region[0];
+		minY = region[1];
+		scale = MAX_DIMENSION / max(region[2] - region[0], region[3] - region[1]);
+		width = scale * (region[2] - region[0]);
+		height = scale * (region[3] - region[1]);
+		return;
+	}
 
-		if(!index--)
-			return line.substr(start, pos - start);
-		pos = pos + !!quote;
+	double maxX = 0.;
+	double maxY = 0.;
+	for(const auto &it : systems)
+	{
+		minX = min(minX, it.second.x);
+		maxX = max(maxX, it.second.x);
+		minY = min(minY, it.second.y);
+		maxY = max(maxY, it.second.y);
 	}
-	return "";
+
+	// Add a slight border around the edges.
+	const double BORDER = .05;
+	double xBorder = (maxX - minX) * BORDER;
+	minX -= xBorder;
+	maxX += xBorder;
+	double yBorder = (maxY - minY) * BORDER;
+	minY -= yBorder;
+	maxY += yBorder;
+
+	// Figure out the scale to apply to the map to keep dimensions below...
+	scale = MAX_DIMENSION / max(maxX - minX, maxY - minY);
+	width = scale * (maxX - minX);
+	height = scale * (maxY - minY);
 }
 
-double Value(const string &line, int index)
+
+
+double Galaxy::X(double x) const
 {
-	double value = 0.;
-	istringstream(Token(line, index)) >> value;
-	return value;
+	return (x - minX) * scale;
 }
 
-void Color(double &r, double &g, double &b, double value)
+
+
+double Galaxy::Y(double y) const
 {
-	value = value * 2. - 1.;
-	if(value < 0.)
+	return (y - minY) * scale;
+}
+
+
+
+Layer GovernmentLayer(const Galaxy &galaxy)
+{
+	Layer layer;
+	layer.name = "government";
+	for(const auto &it : galaxy.systems)
 	{
-		r = 20. + 20. * value;
-		g = 80. + 60. * value;
-		b = 80. - 20. * value;
+		auto git = galaxy.governments.find(it.second.government);
+		if(git != galaxy.governments.end())
+			layer.colors[it.first] = git->second;
 	}
-	else
+	return layer;
+}
+
+
+
+Layer TradeLayer(const Galaxy &galaxy, const Commodity &commodity)
+{
+	Layer layer;
+	layer.name = "trade " + commodity.name;
+	for(const auto &it : galaxy.systems)
 	{
-		r = 20. + 80. * value;
-		g = 80.;
-		b = 80. - 80. * value;
+		auto tit = it.second.trade.find(commodity.name);
+		if(tit != it.second.trade.end())
+		{
+			double value = (tit->second - commodity.low) / (commodity.high - commodity.low);
+			value = max(0., min(1., value));
+			layer.values[it.first] = value;
+			layer.colors[it.first] = Color(value);
+		}
 	}
+	return layer;
 }
 
 
 
-int main(int argc, char *argv[])
+// Color the systems by the given values, scaled so that the lowest is at one
+// end of the color range and the highest at the other.
+Layer AttributeLayer(const string &name, const map<string, double> &values)
 {
-	if(argc <= 1)
-		return 1;
+	Layer layer;
+	layer.name = name;
+	if(values.empty())
+		return layer;
 
-	map<string, double> posX;
-	map<string, double> posY;
-	map<string, string> gov;
-	map<string, double> trade;
-	map<string, set<string>> links;
+	auto range = minmax_element(values.begin(), values.end(),
+		[](const pair<const string, double> &a, const pair<const string, double> &b) { return a.second < b.second; });
+	double low = range.first->second;
+	double high = range.second->second;
+	for(const auto &it : values)
+	{
+		double value = (high > low) ? (it.second - low) / (high - low) : .5;
+		layer.values[it.first] = value;
+		layer.colors[it.first] = Color(value);
+	}
+	return layer;
+}
 
-	map<string, double> govR;
-	map<string, double> govG;
-	map<string, double> govB;
 
-	double minX = 0.;
-	double maxX = 0.;
-	double minY = 0.;
-	double maxY = 0.;
 
-	string line;
-	string name;
+// Get every layer that the galaxy has the data for.
+vector<Layer> AllLayers(const Galaxy &galaxy)
+{
+	vector<Layer> layers;
+	if(!galaxy.governments.empty())
+		layers.push_back(GovernmentLayer(galaxy));
+	for(const Commodity &commodity : galaxy.commodities)
+		layers.push_back(TradeLayer(galaxy, commodity));
+
+	for(const string &attribute : galaxy.attributes)
+	{
+		map<string, double> values;
+		for(const auto &it : galaxy.systems)
+		{
+			auto ait = it.second.attributes.find(attribute);
+			if(ait != it.second.attributes.end())
+				values[it.first] = ait->second;
+		}
+		layers.push_back(AttributeLayer(attribute, values));
+	}
+
+	map<string, double> links;
+	for(const auto &it : galaxy.systems)
+		links[it.first] = it.second.links.size();
+	layers.push_back(AttributeLayer("links", links));
+	return layers;
+}
 
-	// First, read the government file, if any.
-	string commodity;
-	double tradeMin = 0.;
-	double tradeMax = 2000.;
-	if(argv[2] && argv[3])
+
+
+// Rasterize each layer, either as a single image or as a pyramid of tiles.
+int DrawImages(const Galaxy &galaxy, const vector<Layer> &layers, const Options &options)
+{
+	// The scale of the full image, or of each zoom level of the tiles.
+	const int TILE = 256;
+	const double longest = max(1, max(galaxy.width, galaxy.height));
+	vector<double> scales;
+	if(!options.tileLevels)
+		scales.push_back((options.size ? options.size : longest) / longest);
+	for(int level = 0; level < options.tileLevels; ++level)
+		scales.push_back(TILE * static_cast<double>(1 << level) / longest);
+
+	// With --lod, each scale has its own simplified scene. Otherwise, they all
+	// share the full one.
+	vector<Scene> scenes(1, Scene(galaxy));
+	if(options.lod)
 	{
-		commodity = argv[3];
-		ifstream in(argv[2]);
+		const Scene full = scenes.front();
+		scenes.clear();
+		for(double scale : scales)
+			scenes.push_back(full.Simplify(LOD_SIZE / scale));
+	}
+	vector<vector<vector<uint32_t>>> colors(scenes.size());
+	for(size_t s = 0; s < scenes.size(); ++s)
+		for(const Layer &layer : layers)
+			colors[s].push_back(scenes[s].Colors(galaxy, layer));
+
+	// Every image to draw: which layer and scene it is of, the world position of
+	// its top left corner, its scale and size, and where to save it.
+	class Job {
+	public:
+		int layer;
+		int scene;
+		double left;
+		double top;
+		double scale;
+		int width;
+		int height;
+		string path;
+	};
+	vector<Job> jobs;
+	error_code error;
+	const filesystem::path root(options.outputPath);
+	for(size_t i = 0; i < layers.size(); ++i)
+	{
+		const string name = FileName(layers[i].name);
+		if(!options.tileLevels)
+		{
+			double scale = scales.front();
+			jobs.push_back({static_cast<int>(i), 0, 0., 0., scale, max(1, static_cast<int>(galaxy.width * scale)),
+				max(1, static_cast<int>(galaxy.height * scale)), (root / (name + ".png")).string()});
+			continue;
+		}
 
-		while(getline(in, line))
-			if(StartsWith(line, "\tcommodity") && Token(line, 1) == commodity)
+		for(int level = 0; level < options.tileLevels; ++level)
+		{
+			double scale = scales[level];
+			int scene = options.lod ? level : 0;
+			int columns = max(1., ceil(galaxy.width * scale / TILE));
+			int rows = max(1., ceil(galaxy.height * scale / TILE));
+			for(int x = 0; x < columns; ++x)
 			{
-				tradeMin = Value(line, 2);
-				tradeMax = Value(line, 3);
+				filesystem::path directory = root / name / to_string(level) / to_string(x);
+				filesystem::create_directories(directory, error);
+				for(int y = 0; y < rows; ++y)
+					jobs.push_back({static_cast<int>(i), scene, x * TILE / scale, y * TILE / scale, scale, TILE, TILE,
+						(directory / (to_string(y) + ".png")).string()});
 			}
+		}
 	}
-	else if(argv[2])
-	{
-		ifstream in(argv[2]);
 
-		while(getline(in, line))
+	atomic<int> failed(0);
+	ThreadPool pool(options.threads);
+	pool.ForEach(0, jobs.size(), [&](int first, int last)
+	{
+		for(int i = first; i < last; ++i)
 		{
-			if(StartsWith(line, "government"))
-				name = Token(line, 1);
-			else if(StartsWith(line, "\tcolor"))
+			const Job &job = jobs[i];
+			Image image(job.width, job.height);
+			Raster raster(image, job.left, job.top, job.scale);
+			raster.Fill(Raster::Color(0., 0., 0.));
+			// Leave room for any dots that are partly in view.
+			const double margin = 4. / job.scale;
+			scenes[job.scene].Paint(raster, colors[job.scene][job.layer], job.left - margin, job.top - margin,
+				job.left + job.width / job.scale + margin, job.top + job.height / job.scale + margin);
+			// There are many tiles, and most of each one is empty, so favor speed
+			// over size when compressing them.
+			if(!image.Write(job.path, options.tileLevels ? 1 : 6))
 			{
-				govR[name] = Value(line, 1);
-				govG[name] = Value(line, 2);
-				govB[name] = Value(line, 3);
+				cerr << "Unable to write: " << job.path << endl;
+				++failed;
 			}
 		}
-		name.clear();
+	});
+
+	cout << "Drew " << (jobs.size() - failed) << " images of " << layers.size() << " layers in "
+		<< options.outputPath << "." << endl;
+	return failed ? 1 : 0;
+}
+
+
+
+Scene::Scene(const Galaxy &galaxy)
+	: width(galaxy.width), height(galaxy.height)
+{
+	map<string, int> index;
+	for(const auto &it : galaxy.systems)
+	{
+		int i = index.size();
+		index[it.first] = i;
+		points.push_back(galaxy.X(it.second.x));
+		points.push_back(galaxy.Y(it.second.y));
+		offsets.push_back(i);
+		members.push_back(i);
 	}
+	offsets.push_back(members.size());
+
+	for(const auto &it : galaxy.systems)
+		for(const string &link : it.second.links)
+		{
+			auto lit = index.find(link);
+			if(link <= it.first || lit == index.end())
+				continue;
+			const int a = index[it.first];
+			const int b = lit->second;
+			ends.insert(ends.end(), {a, b});
+			lines.insert(lines.end(), {points[2 * a], points[2 * a + 1], points[2 * b], points[2 * b + 1]});
+		}
+	Finish();
+}
+
 
-	// Now, parse the map.
-	ifstream in(argv[1]);
-	while(getline(in, line))
+
+Scene Scene::Simplify(double cellSize) const
+{
+	// Find the deepest level of the quadtree whose cells are big enough.
+	const int DEPTH = 16;
+	int level = (extent > cellSize) ? static_cast<int>(log2(extent / cellSize)) : 0;
+	const int shift = 2 * (DEPTH - max(0, min(DEPTH, level)));
+
+	// The points in each cell are next to each other in the sorted order.
+	Scene result(width, height);
+	result.offsets.push_back(0);
+	vector<int> cluster(points.size() / 2);
+	for(size_t first = 0; first < order.size(); )
 	{
-		if(StartsWith(line, "system"))
-			name = Token(line, 1);
-		else if(StartsWith(line, "\tpos") && !name.empty())
+		const uint32_t cell = codes[order[first]] >> shift;
+		const int id = result.offsets.size() - 1;
+		size_t last = first;
+		double x = 0.;
+		double y = 0.;
+		for( ; last < order.size() && (codes[order[last]] >> shift) == cell; ++last)
 		{
-			double x = Value(line, 1);
-			double y = Value(line, 2);
-			minX = min(minX, x);
-			maxX = max(maxX, x);
-			minY = min(minY, y);
-			maxY = max(maxY, y);
-			posX[name] = x;
-			posY[name] = y;
+			int i = order[last];
+			cluster[i] = id;
+			x += points[2 * i];
+			y += points[2 * i + 1];
+			result.members.insert(result.members.end(), members.begin() + offsets[i], members.begin() + offsets[i + 1]);
 		}
-		else if(StartsWith(line, "\tgovernment") && !name.empty())
-			gov[name] = Token(line, 1);
-		else if(StartsWith(line, "\tlink") && !name.empty())
-			links[name].insert(Token(line, 1));
-		else if(StartsWith(line, "\ttrade") && !name.empty() && Token(line, 1) == commodity)
-			trade[name] = max(0., min(1., (Value(line, 2) - tradeMin) / (tradeMax - tradeMin)));
-		else if(!StartsWith(line, "\t"))
-			name.clear();
+		result.points.push_back(x / (last - first));
+		result.points.push_back(y / (last - first));
+		result.offsets.push_back(result.members.size());
+		first = last;
 	}
 
-	// Add a slight border around the edges.
-	const double BORDER = .05;
-	double xBorder = (maxX - minX) * BORDER;
-	minX -= xBorder;
-	maxX += xBorder;
-	double yBorder = (maxY - minY) * BORDER;
-	minY -= yBorder;
-	maxY += yBorder;
+	// Link any two groups that have links between them.
+	vector<pair<int, int>> links;
+	for(size_t i = 0; i < ends.size(); i += 2)
+	{
+		int a = cluster[ends[i]];
+		int b = cluster[ends[i + 1]];
+		if(a != b)
+			links.emplace_back(min(a, b), max(a, b));
+	}
+	sort(links.begin(), links.end());
+	links.erase(unique(links.begin(), links.end()), links.end());
+	for(const pair<int, int> &link : links)
+	{
+		const int a = link.first;
+		const int b = link.second;
+		result.ends.insert(result.ends.end(), {a, b});
+		result.lines.insert(result.lines.end(),
+			{result.points[2 * a], result.points[2 * a + 1], result.points[2 * b], result.points[2 * b + 1]});
+	}
+	result.Finish();
+	return result;
+}
 
-	// Figure out the scale to apply to the map to keep dimensions below...
-	const double MAX_DIMENSION = 600.;
-	double scale = MAX_DIMENSION / max(maxX - minX, maxY - minY);
-	int width = scale * (maxX - minX);
-	int height = scale * (maxY - minY);
-	cout << "<svg width=\"" << width << "\" height=\"" << height << "\">" << endl;
-	cout << "<rect width=\"" << width << "\" height=\"" << height << "\" fill=\"black\" />" << endl;
-
-	// Draw the links.
-	for(const auto &it : posX)
-	{
-		string system = it.first;
-		double x1 = (posX[system] - minX) * scale;
-		double y1 = (posY[system] - minY) * scale;
-		for(const string &link : links[system])
-		{
-			// Only draw links in one direction.
-			if(link <= system)
-				continue;
-			double x2 = (posX[link] - minX) * scale;
-			double y2 = (posY[link] - minY) * scale;
 
-			cout << "<line x1=\"" << x1 << "\" y1=\"" << y1 << "\" x2=\"" << x2 << "\" y2=\"" << y2
-				<< "\" style=\"stroke:#666666\" />" << endl;
+
+vector<uint32_t> Scene::Colors(const Galaxy &galaxy, const Layer &layer) const
+{
+	// Look up the color and value of each system, in the galaxy's order. NaN
+	// means a system has no value.
+	vector<uint32_t> systemColors;
+	vector<double> values;
+	for(const auto &it : galaxy.systems)
+	{
+		auto cit = layer.colors.find(it.first);
+		const Rgb color = (cit == layer.colors.end()) ? Rgb() : cit->second;
+		systemColors.push_back(Raster::Color(color.r / 100., color.g / 100., color.b / 100.));
+		auto vit = layer.values.find(it.first);
+		values.push_back((vit == layer.values.end()) ? NAN : vit->second);
+	}
+
+	vector<uint32_t> colors;
+	map<uint32_t, int> votes;
+	for(size_t i = 0; i + 1 < offsets.size(); ++i)
+	{
+		const int first = offsets[i];
+		const int last = offsets[i + 1];
+		if(last - first == 1)
+		{
+			colors.push_back(systemColors[members[first]]);
+			continue;
+		}
+
+		if(!layer.values.empty())
+		{
+			// Average the values of the systems that have one.
+			double sum = 0.;
+			int count = 0;
+			for(int m = first; m < last; ++m)
+				if(!std::isnan(values[members[m]]))
+				{
+					sum += values[members[m]];
+					++count;
+				}
+			const Rgb color = count ? Color(sum / count) : Rgb();
+			colors.push_back(Raster::Color(color.r / 100., color.g / 100., color.b / 100.));
+			continue;
+		}
+
+		// Otherwise, use the most common color, such as that of the government
+		// most of the systems belong to. A tie goes to the color that got there
+		// first, so that no color is favored over any other.
+		votes.clear();
+		uint32_t winner = 0;
+		int most = 0;
+		for(int m = first; m < last; ++m)
+		{
+			uint32_t color = systemColors[members[m]];
+			int count = ++votes[color];
+			if(count > most)
+			{
+				winner = color;
+				most = count;
+			}
 		}
+		colors.push_back(winner);
 	}
+	return colors;
+}
+
+
+
+void Scene::Paint(Raster &raster, const vector<uint32_t> &colors,
+	double left, double top, double right, double bottom) const
+{
+	const uint32_t LINK_COLOR = Raster::Color(.4, .4, .4);
+	for(int i : VisibleLinks(left, top, right, bottom))
+		raster.Line(lines[4 * i], lines[4 * i + 1], lines[4 * i + 2], lines[4 * i + 3], 1., LINK_COLOR);
 
-	// Draw circles for the systems.
 	const double RADIUS = 2.;
-	for(const auto &it : posX)
-	{
-		string system = it.first;
-		double x = (posX[system] - minX) * scale;
-		double y = (posY[system] - minY) * scale;
-		double r = 100.;
-		double g = 100.;
-		double b = 100.;
-		auto cit = trade.find(system);
-		auto git = gov.find(system);
-		if(cit != trade.end())
-			Color(r, g, b, cit->second);
-		else if(git != gov.end() && govR.find(git->second) != govR.end())
-		{
-			r = 100. * govR[git->second];
-			g = 100. * govG[git->second];
-			b = 100. * govB[git->second];
-		}
-		else
-			cerr << system << endl;
+	for(int i : VisibleSystems(left, top, right, bottom))
+		raster.Circle(points[2 * i], points[2 * i + 1], RADIUS, colors[i]);
+}
 
-		cout << "<circle cx=\"" << x << "\" cy=\"" << y << "\" r=\"" << RADIUS
-			<< "\" fill=\"rgb(" << r << "%, " << g << "%, " << b << "%)\" />" << endl;
+
+
+bool Scene::Write(SvgWriter &out, const vector<uint32_t> &colors) const
+{
+	if(!out.IsOpen())
+		return false;
+
+	out.Begin(width, height);
+	out.Rect(0., 0., width, height, "fill=\"black\"");
+	// Leave room for any dots that are partly in view.
+	const double MARGIN = 3.;
+	for(int i : VisibleLinks(-MARGIN, -MARGIN, width + MARGIN, height + MARGIN))
+		out.Line(lines[4 * i], lines[4 * i + 1], lines[4 * i + 2], lines[4 * i + 3], "stroke=\"#666\"");
+
+	// Draw the systems as dots, so that all the ones of the same color can be
+	// batched together.
+	map<uint32_t, string> styles;
+	for(int i : VisibleSystems(-MARGIN, -MARGIN, width + MARGIN, height + MARGIN))
+	{
+		uint32_t color = colors[i];
+		string &style = styles[color];
+		if(style.empty())
+			style = "stroke=\"" + SvgWriter::Color(((color >> 16) & 0xFF) / 255., ((color >> 8) & 0xFF) / 255.,
+				(color & 0xFF) / 255.) + "\" stroke-width=\"4\" stroke-linecap=\"round\"";
+		out.Dot(points[2 * i], points[2 * i + 1], style);
+	}
+	return out.Close();
+}
+
+
+
+Scene::Scene(int width, int height)
+	: width(width), height(height)
+{
+}
+
+
+
+void Scene::Finish()
+{
+	const int count = points.size() / 2;
+	for(int i = 0; i < count; ++i)
+		systemIndex.Add(points[2 * i], points[2 * i + 1]);
+	systemIndex.Finish();
+	for(size_t i = 0; i < lines.size(); i += 4)
+	{
+		linkIndex.Add(.5 * (lines[i] + lines[i + 2]), .5 * (lines[i + 1] + lines[i + 3]));
+		linkReach = max(linkReach, .5 * max(fabs(lines[i + 2] - lines[i]), fabs(lines[i + 3] - lines[i + 1])));
 	}
+	linkIndex.Finish();
+
+	// Give each point a place in the quadtree, by splitting the square that
+	// holds all of them 2^16 ways in each direction.
+	if(!count)
+		return;
+	double left = points[0];
+	double top = points[1];
+	double right = left;
+	double bottom = top;
+	for(int i = 0; i < count; ++i)
+	{
+		left = min(left, points[2 * i]);
+		right = max(right, points[2 * i]);
+		top = min(top, points[2 * i + 1]);
+		bottom = max(bottom, points[2 * i + 1]);
+	}
+	extent = max(right - left, bottom - top);
+	const double scale = extent ? 65535. / extent : 0.;
+	codes.resize(count);
+	for(int i = 0; i < count; ++i)
+	{
+		uint32_t x = (points[2 * i] - left) * scale;
+		uint32_t y = (points[2 * i + 1] - top) * scale;
+		uint32_t code = 0;
+		for(int bit = 15; bit >= 0; --bit)
+			code = (code << 2) | (((y >> bit) & 1) << 1) | ((x >> bit) & 1);
+		codes[i] = code;
+	}
+	order.resize(count);
+	for(int i = 0; i < count; ++i)
+		order[i] = i;
+	stable_sort(order.begin(), order.end(), [this](int a, int b) { return codes[a] < codes[b]; });
+}
+
+
 
-	cout << "</svg>" << endl;
-	return 0;
+vector<int> Scene::VisibleLinks(double left, double top, double right, double bottom) const
+{
+	vector<int> result = linkIndex.InRect(left - linkReach, top - linkReach, right + linkReach, bottom + linkReach);
+	// Skip any links that only came close to the rectangle.
+	auto outside = [&](int i)
+	{
+		const double *line = &lines[4 * i];
+		return max(line[0], line[2]) < left || min(line[0], line[2]) > right
+			|| max(line[1], line[3]) < top || min(line[1], line[3]) > bottom;
+	};
+	result.erase(remove_if(result.begin(), result.end(), outside), result.end());
+	return result;
+}
+
+
+
+vector<int> Scene::VisibleSystems(double left, double top, double right, double bottom) const
+{
+	return systemIndex.InRect(left, top, right, bottom);
+}
+
+
+
+// Turn a layer name into a file name.
+string FileName(const string &name)
+{
+	string result;
+	for(char c : name)
+		result += isalnum(static_cast<unsigned char>(c)) ? tolower(c) : '-';
+	return result;
+}
+
+
+
+bool IsNumber(const string &token)
+{
+	char *end = nullptr;
+	strtod(token.c_str(), &end);
+	return !token.empty() && !*end;
+}
+
+
+
+// Parse a region given as "left,top,right,bottom".
+bool ParseRegion(const char *text, vector<double> &region)
+{
+	region.clear();
+	while(true)
+	{
+		char *end = nullptr;
+		region.push_back(strtod(text, &end));
+		if(end == text)
+			return false;
+		if(!*end)
+			break;
+		if(*end != ',')
+			return false;
+		text = end + 1;
+	}
+	return region.size() == 4 && region[2] > region[0] && region[3] > region[1];
+}
+
+
+
+Rgb Color(double value)
+{
+	Rgb color;
+	value = value * 2. - 1.;
+	if(value < 0.)
+	{
+		color.r = 20. + 20. * value;
+		color.g = 80. + 60. * value;
+		color.b = 80. - 20. * value;
+	}
+	else
+	{
+		color.r = 20. + 80. * value;
+		color.g = 80.;
+		color.b = 80. - 80. * value;
+	}
+	return color;
+}
+
+
+
+void PrintHelp()
+{
+	cerr << endl;
+	cerr << "Usage: $ mapper <map> [governments] > map.svg" << endl;
+	cerr << "   Draws a map of the galaxy, with each system colored by its government." << endl;
+	cerr << "Or: $ mapper <map> <commodities> <commodity> > map.svg" << endl;
+	cerr << "   Colors each system by its price of the given commodity instead, relative to that" << endl;
+	cerr << "   commodity's price range (given in a \"trade\" node of the commodities file)." << endl;
+	cerr << "Or: $ mapper [--threads <count>] --output <directory> <map> [data file]..." << endl;
+	cerr << "   Draws every layer that the given files have data for: governments, the price of" << endl;
+	cerr << "   each commodity, each numeric attribute of the systems, and the number of links." << endl;
+	cerr << "   Each layer is written to its own file in the given directory." << endl;
+	cerr << "   --svgz: compress the SVG files." << endl;
+	cerr << "   --png: draw PNG images instead of SVG files." << endl;
+	cerr << "   --size <pixels>: the larger of the width and height of each PNG image." << endl;
+	cerr << "   --tiles <levels>: draw each layer as 256x256 PNG tiles, at that many zoom levels," << endl;
+	cerr << "      named <layer>/<level>/<column>/<row>.png." << endl;
+	cerr << "   --lod: draw systems whose dots would overlap as a single dot." << endl;
+	cerr << "   --region <left>,<top>,<right>,<bottom>: only draw the given part of the map." << endl;
+	cerr << "   --threads: how many threads to draw with (default: one per core)." << endl;
+	cerr << endl;
 }
@@ -0,0 +1,366 @@
+/* DataEditor.cpp
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "DataEditor.h"
+
+#include "DataNode.h"
+
+#if defined __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+
+using namespace std;
+
+namespace {
+	// Unchanged stretches of the file shorter than this are not worth asking
+	// the kernel to copy for us.
+	const size_t MIN_KERNEL_COPY = 4096;
+
+	// Indent every non-empty line of the given text, and make sure it ends in a
+	// newline.
+	string Indent(const string &text, const string &indent)
+	{
+		string result;
+		result.reserve(text.length() + indent.length() + 1);
+		bool lineStart = true;
+		for(char c : text)
+		{
+			if(lineStart && c != '\n')
+				result += indent;
+			result += c;
+			lineStart = (c == '\n');
+		}
+		if(!lineStart)
+			result += '\n';
+		return result;
+	}
+
+#if defined __linux__
+	// Write the whole buffer, retrying on short writes.
+	bool WriteAll(int fd, const char *data, size_t size)
+	{
+		while(size)
+		{
+			ssize_t written = write(fd, data, size);
+			if(written <= 0)
+				return false;
+			data += written;
+			size -= written;
+		}
+		return true;
+	}
+#endif
+}
+
+
+
+DataEditor::DataEditor(const string &path)
+	: path(path)
+{
+#if defined __linux__
+	struct stat info;
+	if(!stat(path.c_str(), &info))
+		modified = info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+	file.Load(path, true);
+}
+
+
+
+list<DataNode>::const_iterator DataEditor::begin() const
+{
+	return file.begin();
+}
+
+
+
+list<DataNode>::const_iterator DataEditor::end() const
+{
+	return file.end();
+}
+
+
+
+bool DataEditor::Replace(const DataNode &node, const string &text)
+{
+	return AddEdit(node, node.LineBegin(), node.SubtreeEnd(), text, Indentation(node));
+}
+
+
+
+bool DataEditor::ReplaceLine(const DataNode &node, const string &text)
+{
+	const size_t end = ContentEnd(node);
+	if(end == node.LineEnd())
+		return AddEdit(node, node.LineBegin(), node.LineEnd(), text, Indentation(node));
+	// The rest of the line, including its newline, stays where it is.
+	return AddEdit(node, node.LineBegin(), end, text, Indentation(node), false);
+}
+
+
+
+bool DataEditor::Remove(const DataNode &node)
+{
+	return AddEdit(node, node.LineBegin(), node.SubtreeEnd(), "", "");
+}
+
+
+
+bool DataEditor::InsertAfter(const DataNode &node, const string &text)
+{
+	return AddEdit(node, node.SubtreeEnd(), node.SubtreeEnd(), text, Indentation(node));
+}
+
+
+
+bool DataEditor::AddChild(const DataNode &node, const string &text)
+{
+	// Match the indentation of any existing children.
+	string indent = node.HasChildren() ? Indentation(*node.begin()) : Indentation(node) + '\t';
+	return AddEdit(node, node.SubtreeEnd(), node.SubtreeEnd(), text, indent);
+}
+
+
+
+void DataEditor::Append(const string &text)
+{
+	const string &source = file.Source();
+	string separator = (source.empty() || source.back() == '\n') ? "" : "\n";
+	Edit &edit = edits.emplace(Key(source.size(), false), Edit())->second;
+	edit.end = source.size();
+	edit.text = separator + Indent(text, "");
+}
+
+
+
+int DataEditor::EditCount() const
+{
+	return edits.size();
+}
+
+
+
+string DataEditor::ToString() const
+{
+	const string &source = file.Source();
+	size_t size = source.size();
+	for(const auto &it : edits)
+		size += it.second.text.size();
+
+	string result;
+	result.reserve(size);
+	size_t pos = 0;
+	for(const auto &it : edits)
+	{
+		result.append(source, pos, it.first.first - pos);
+		result += it.second.text;
+		pos = it.second.end;
+	}
+	result.append(source, pos, string::npos);
+	return result;
+}
+
+
+
+bool DataEditor::Save(const string &outPath) const
+{
+#if defined __linux__
+	const string &source = file.Source();
+
+	// If the original is still on disk exactly as it was loaded, the kernel can
+	// copy all the unchanged parts of it directly into the new file.
+	int in = open(path.c_str(), O_RDONLY);
+	struct stat info;
+	bool canCopy = (in >= 0 && !fstat(in, &info) && static_cast<size_t>(info.st_size) == source.size()
+		&& info.st_mtim.tv_sec * 1000000000LL + info.st_mtim.tv_nsec == modified);
+
+	// The new file replaces the one at the output path, so it should have the
+	// same permissions. If there is no file there yet, copy the original's.
+	struct stat target;
+	bool hasMode = !stat(outPath.c_str(), &target);
+	if(!hasMode && in >= 0 && !fstat(in, &target))
+		hasMode = true;
+
+	// Write to a temporary file, so that the original stays intact (and can
+	// still be copied from) until the new file is complete.
+	string temp = outPath + ".tmp";
+	int out = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(out < 0 || (hasMode && fchmod(out, target.st_mode & 07777)))
+	{
+		if(out >= 0)
+		{
+			close(out);
+			remove(temp.c_str());
+		}
+		if(in >= 0)
+			close(in);
+		return false;
+	}
+
+	// Small pieces are gathered into a buffer and written all at once.
+	string buffer;
+	bool success = true;
+	auto flush = [&]() {
+		success &= WriteAll(out, buffer.data(), buffer.size());
+		buffer.clear();
+	};
+	auto copy = [&](size_t begin, size_t end) {
+		if(canCopy && end - begin >= MIN_KERNEL_COPY)
+		{
+			flush();
+			loff_t offset = begin;
+			while(offset < static_cast<loff_t>(end))
+			{
+				ssize_t copied = copy_file_range(in, &offset, out, nullptr, end - offset, 0);
+				if(copied <= 0)
+				{
+					// The file system does not support this, so fall back
+					// to writing the data from memory.
+					canCopy = false;
+					break;
+				}
+			}
+			begin = offset;
+		}
+		buffer.append(source, begin, end - begin);
+		if(buffer.size() >= MIN_KERNEL_COPY)
+			flush();
+	};
+
+	size_t pos = 0;
+	for(const auto &it : edits)
+	{
+		copy(pos, it.first.first);
+		buffer += it.second.text;
+		pos = it.second.end;
+	}
+	copy(pos, source.size());
+	flush();
+
+	success &= !close(out);
+	if(in >= 0)
+		close(in);
+	if(success)
+		success = !rename(temp.c_str(), outPath.c_str());
+	if(!success)
+		remove(temp.c_str());
+	return success;
+#else
+	string output = ToString();
+	FILE *out = fopen(outPath.c_str(), "wb");
+	if(!out)
+		return false;
+	bool success = (fwrite(output.data(), 1, output.size(), out) == output.size());
+	return !fclose(out) && success;
+#endif
+}
+
+
+
+bool DataEditor::AddEdit(const DataNode &node, size_t begin, size_t end, const string &text, const string &indent,
+	bool endLine)
+{
+	if(!node.IsFrom(file.Source()) || end > file.Source().size() + 1)
+	{
+		node.PrintTrace("Cannot edit a node that did not come from this file:");
+		return false;
+	}
+	// If the file has no final newline, the last node ends at the end of the file.
+	begin = min(begin, file.Source().size());
+	end = min(end, file.Source().size());
+
+	// An edit may not overlap any part of the file that is already being
+	// replaced. Existing edits never overlap each other, so only the closest
+	// one before this edit needs to be checked, plus any that begin within it.
+	Key key(begin, begin != end);
+	auto it = edits.lower_bound(key);
+	if(it != edits.begin())
+	{
+		auto before = prev(it);
+		if(before->first.second && before->second.end > begin)
+			it = before;
+	}
+	for( ; it != edits.end() && it->first.first < max(end, begin + 1); ++it)
+	{
+		bool isReplacement = it->first.second;
+		bool overlaps = (begin == end) ? (isReplacement && it->first.first < begin && it->second.end > begin)
+			: (isReplacement || it->first.first > begin);
+		if(overlaps)
+		{
+			node.PrintTrace("Cannot make two overlapping edits to a file:");
+			return false;
+		}
+	}
+
+	Edit &edit = edits.emplace(key, Edit())->second;
+	edit.end = end;
+	edit.text = text.empty() ? text : Indent(text, indent);
+	if(!endLine && !edit.text.empty())
+		edit.text.pop_back();
+	// Something inserted after the last line of a file with no final newline
+	// must still start on a line of its own.
+	const string &source = file.Source();
+	if(begin == end && begin == source.size() && !source.empty() && source.back() != '\n')
+		edit.text.insert(0, 1, '\n');
+	return true;
+}
+
+
+
+// Get the white space that a node's line begins with.
+string DataEditor::Indentation(const DataNode &node) const
+{
+	const string &source = file.Source();
+	size_t begin = min(node.LineBegin(), source.size());
+	size_t end = begin;
+	while(end < source.size() && source[end] <= ' ' && source[end] != '\n')
+		++end;
+	return source.substr(begin, end - begin);
+}
+
+
+
+// Get where a node's line ends, not counting any comment at the end of it or
+// the white space before that comment. This finds the tokens the same way that
+// DataFile does. If there is no comment, this is just the end of the line.
+size_t DataEditor::ContentEnd(const DataNode &node) const
+{
+	const string &source = file.Source();
+	const size_t end = min(node.LineEnd(), source.size());
+	size_t it = min(node.LineBegin(), end);
+	while(it < end && source[it] <= ' ' && source[it] != '\n')
+		++it;
+
+	size_t contentEnd = it;
+	while(it < end && source[it] != '\n' && source[it] != '#')
+	{
+		const char endQuote = source[it];
+		const bool isQuoted = (endQuote == '"' || endQuote == '`');
+		it += isQuoted;
+		while(it < end && source[it] != '\n' && (isQuoted ? source[it] != endQuote : source[it] > ' '))
+			++it;
+		it += (isQuoted && it < end && source[it] == endQuote);
+		contentEnd = it;
+		while(it < end && source[it] <= ' ' && source[it] != '\n')
+			++it;
+	}
+	return (it < end && source[it] == '#') ? contentEnd : node.LineEnd();
+}
@@ -0,0 +1,99 @@
+/* DataEditor.h
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef DATA_EDITOR_H_
+#define DATA_EDITOR_H_
+
+#include "DataFile.h"
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+
+class DataNode;
+
+
+
+// Class for making targeted changes to a data file without reformatting it. The
+// file is loaded with its source retained, and each edit replaces only the bytes
+// belonging to one node; everything in between, including comments and any
+// unusual formatting, is copied through unchanged when the file is saved. Text
+// passed in to an edit should be formatted as if it were at the root level (for
+// example, the output of a DataWriter). It will be indented to match the spot
+// in the file where it is placed.
+class DataEditor {
+public:
+	DataEditor(const std::string &path);
+
+	DataEditor(const DataEditor &) = delete;
+	DataEditor &operator=(const DataEditor &) = delete;
+
+	std::list<DataNode>::const_iterator begin() const;
+	std::list<DataNode>::const_iterator end() const;
+
+	// Replace a node and all of its children.
+	bool Replace(const DataNode &node, const std::string &text);
+	// Replace just the node's own line, leaving its children alone. Any comment
+	// at the end of the line is kept, after the new text.
+	bool ReplaceLine(const DataNode &node, const std::string &text);
+	// Remove a node and all of its children.
+	bool Remove(const DataNode &node);
+	// Insert a new sibling after the given node and all its children.
+	bool InsertAfter(const DataNode &node, const std::string &text);
+	// Add a new child after all of the given node's existing children.
+	bool AddChild(const DataNode &node, const std::string &text);
+	// Add text at the very end of the file.
+	void Append(const std::string &text);
+
+	int EditCount() const;
+
+	// Get the edited file contents.
+	std::string ToString() const;
+	// Write the edited file. The path may be the same as the original file. If
+	// it already exists, its permissions are kept.
+	bool Save(const std::string &path) const;
+
+
+private:
+	// Edits are sorted by where they start. An insertion sorts before a
+	// replacement that starts at the same place.
+	typedef std::pair<size_t, bool> Key;
+	class Edit {
+	public:
+		size_t end;
+		std::string text;
+	};
+
+
+private:
+	bool AddEdit(const DataNode &node, size_t begin, size_t end, const std::string &text, const std::string &indent,
+		bool endLine = true);
+	std::string Indentation(const DataNode &node) const;
+	size_t ContentEnd(const DataNode &node) const;
+
+
+private:
+	std::string path;
+	DataFile file;
+	std::multimap<Key, Edit> edits;
+	// The modification time of the file when it was loaded.
+	long long modified = 0;
+};
+
+
+
+#endif
@@ -26,21 +26,21 @@ using namespace std;
 
 
 
-DataFile::DataFile(const string &path)
+DataFile::DataFile(const string &path, bool keepSource)
 {
-	Load(path);
+	Load(path, keepSource);
 }
 
 
 
-DataFile::DataFile(istream &in)
+DataFile::DataFile(istream &in, bool keepSource)
 {
-	Load(in);
+	Load(in, keepSource);
 }
 
 
 
-void DataFile::Load(const string &path)
+void DataFile::Load(const string &path, bool keepSource)
 {
 #if defined _WIN32
 	FILE *file = _wfopen(ToUTF16(path).c_str(), L"rb");
@@ -65,16 +65,25 @@ void DataFile::Load(const string &path)
 	if(bytes != data.size())
 		throw runtime_error("Error reading file!");
 
+	fclose(file);
+
 	// As a sentinel, make sure the file always ends in a newline.
-	if(data.empty() || data.back() != '\n')
+	bool hasSentinel = (data.empty() || data.back() != '\n');
+	if(hasSentinel)
 		data.push_back('\n');
 
-	Load(&*data.begin(), &*data.end());
+	Load(&*data.begin(), &*data.end(), keepSource);
+	if(keepSource)
+	{
+		if(hasSentinel)
+			data.pop_back();
+		source.swap(data);
+	}
 }
 
 
 
-void DataFile::Load(istream &in)
+void DataFile::Load(istream &in, bool keepSource)
 {
 	vector<char> data;
 
@@ -87,10 +96,13 @@ void DataFile::Load(istream &in)
 		data.resize(currentSize + in.gcount());
 	}
 	// As a sentinel, make sure the file always ends in a newline.
-	if(data.back() != '\n')
+	bool hasSentinel = (data.empty() || data.back() != '\n');
+	if(hasSentinel)
 		data.push_back('\n');
 
-	Load(&*data.begin(), &*data.end());
+	Load(&*data.begin(), &*data.end(), keepSource);
+	if(keepSource)
+		source.assign(data.begin(), data.end() - hasSentinel);
 }
 
 
@@ -109,13 +121,28 @@ list<DataNode>::const_iterator DataFile::end() const
 
 
 
-void DataFile::Load(const char *it, const char *end)
+const string &DataFile::Source() const
+{
+	return source;
+}
+
+
+
+void DataFile::Load(const char *begin, const char *end, bool keepSource)
 {
 	vector<DataNode *> stack(1, &root);
 	vector<int> whiteStack(1, -1);
 
-	for( ; it != end; ++it)
+	// If the source is being kept, comment lines are saved up until the node
+	// that they precede is found.
+	vector<string> comments;
+	int lineNumber = 0;
+
+	for(const char *it = begin; it != end; ++it)
 	{
+		const char *lineBegin = it;
+		++lineNumber;
+
 		// Find the first non-white character in this line.
 		int white = 0;
 		for( ; *it <= ' ' && *it != '\n'; ++it)
@@ -124,8 +151,11 @@ void DataFile::Load(const char *it, const char *end)
 		// If the line is a comment, skip to the end of the line.
 		if(*it == '#')
 		{
+			const char *commentBegin = it;
 			while(*it != '\n')
 				++it;
+			if(keepSource)
+				comments.push_back(CommentText(commentBegin, it));
 		}
 		// Skip empty lines (including comment lines).
 		if(*it == '\n')
@@ -181,10 +211,39 @@ void DataFile::Load(const char *it, const char *end)
 				// of this line of the file.
 				if(*it == '#')
 				{
+					const char *commentBegin = it;
 					while(*it != '\n')
 						++it;
+					if(keepSource)
+						comments.push_back(CommentText(commentBegin, it));
 				}
 			}
 		}
+
+		if(keepSource)
+		{
+			node.source = &source;
+			node.lineNumber = lineNumber;
+			node.lineBegin = lineBegin - begin;
+			node.lineEnd = it + 1 - begin;
+			node.comments.swap(comments);
+			comments.clear();
+			// This line is now the last line of every node it is nested in.
+			for(DataNode *parent : stack)
+				parent->subtreeEnd = node.lineEnd;
+		}
 	}
 }
+
+
+
+// Get the text of a comment, without the '#' or the space that usually follows it.
+string DataFile::CommentText(const char *it, const char *end)
+{
+	++it;
+	if(it != end && *it == ' ')
+		++it;
+	while(end != it && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+		--end;
+	return string(it, end);
+}
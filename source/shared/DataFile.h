@@ -20,6 +20,7 @@ this program. If not, see <https://www.gnu.org/licenses/>.
 
 #include <istream>
 #include <list>
+#include <string>
 
 
 
@@ -29,25 +30,38 @@ this program. If not, see <https://www.gnu.org/licenses/>.
 // it, it is a "child" of that node. Otherwise, it is a "sibling." Each node is
 // just a collection of one or more tokens that can be interpreted either as
 // strings or as floating point values; see DataNode for more information.
+// If asked to, a DataFile also keeps the raw text it was loaded from, and each
+// node remembers its position in that text along with any comments on it.
 class DataFile {
 public:
 	DataFile() = default;
-	DataFile(const std::string &path);
-	DataFile(std::istream &in);
+	DataFile(const std::string &path, bool keepSource = false);
+	DataFile(std::istream &in, bool keepSource = false);
 
-	void Load(const std::string &path);
-	void Load(std::istream &in);
+	// Each node points to this file's source text, so a copy would have nodes
+	// pointing into the wrong file.
+	DataFile(const DataFile &) = delete;
+	DataFile &operator=(const DataFile &) = delete;
+
+	void Load(const std::string &path, bool keepSource = false);
+	void Load(std::istream &in, bool keepSource = false);
 
 	std::list<DataNode>::const_iterator begin() const;
 	std::list<DataNode>::const_iterator end() const;
 
+	// The exact contents of the file, if the source was kept. Node offsets are
+	// relative to the start of this string.
+	const std::string &Source() const;
+
 
 private:
-	void Load(const char *it, const char *end);
+	void Load(const char *begin, const char *end, bool keepSource);
+	static std::string CommentText(const char *it, const char *end);
 
 
 private:
 	DataNode root;
+	std::string source;
 };
 
 
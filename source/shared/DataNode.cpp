@@ -33,7 +33,9 @@ DataNode::DataNode(const DataNode *parent)
 
 
 DataNode::DataNode(const DataNode &other)
-	: children(other.children), tokens(other.tokens)
+	: children(other.children), tokens(other.tokens), source(other.source), lineNumber(other.lineNumber),
+	lineBegin(other.lineBegin), lineEnd(other.lineEnd), subtreeEnd(other.subtreeEnd),
+	comments(other.comments)
 {
 }
 
@@ -43,6 +45,12 @@ DataNode &DataNode::operator=(const DataNode &other)
 {
 	children = other.children;
 	tokens = other.tokens;
+	source = other.source;
+	lineNumber = other.lineNumber;
+	lineBegin = other.lineBegin;
+	lineEnd = other.lineEnd;
+	subtreeEnd = other.subtreeEnd;
+	comments = other.comments;
 	return *this;
 }
 
@@ -141,6 +149,55 @@ list<DataNode>::const_iterator DataNode::end() const
 
 
 
+bool DataNode::HasSource() const
+{
+	return lineNumber;
+}
+
+
+
+bool DataNode::IsFrom(const string &source) const
+{
+	return this->source == &source;
+}
+
+
+
+int DataNode::LineNumber() const
+{
+	return lineNumber;
+}
+
+
+
+size_t DataNode::LineBegin() const
+{
+	return lineBegin;
+}
+
+
+
+size_t DataNode::LineEnd() const
+{
+	return lineEnd;
+}
+
+
+
+size_t DataNode::SubtreeEnd() const
+{
+	return subtreeEnd;
+}
+
+
+
+const vector<string> &DataNode::Comments() const
+{
+	return comments;
+}
+
+
+
 // Print a message followed by a "trace" of this node and its parents.
 int DataNode::PrintTrace(const string &message) const
 {
@@ -16,6 +16,7 @@ this program. If not, see <https://www.gnu.org/licenses/>.
 #ifndef DATA_NODE_H_
 #define DATA_NODE_H_
 
+#include <cstddef>
 #include <list>
 #include <string>
 #include <vector>
@@ -43,6 +44,22 @@ public:
 	std::list<DataNode>::const_iterator begin() const;
 	std::list<DataNode>::const_iterator end() const;
 
+	// If the file this node came from was loaded with its source retained, these
+	// give the line number of this node and the byte offsets of its own line and
+	// of its entire subtree within that source. The line begins at its first
+	// indentation character and ends just past its newline.
+	bool HasSource() const;
+	// Check whether this node's offsets refer to the given source text, that
+	// is, whether it was loaded from the DataFile that the text belongs to.
+	bool IsFrom(const std::string &source) const;
+	int LineNumber() const;
+	size_t LineBegin() const;
+	size_t LineEnd() const;
+	size_t SubtreeEnd() const;
+	// Any comment lines directly above this node, followed by any comment at the
+	// end of this node's own line. Only retained along with the source.
+	const std::vector<std::string> &Comments() const;
+
 	// Print a message followed by a "trace" of this node and its parents.
 	int PrintTrace(const std::string &message = "") const;
 
@@ -52,6 +69,14 @@ private:
 	std::vector<std::string> tokens;
 	const DataNode *parent = nullptr;
 
+	// Where this node came from, if the source was kept.
+	const std::string *source = nullptr;
+	int lineNumber = 0;
+	size_t lineBegin = 0;
+	size_t lineEnd = 0;
+	size_t subtreeEnd = 0;
+	std::vector<std::string> comments;
+
 	friend class DataFile;
 };
 
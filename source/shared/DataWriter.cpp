@@ -48,6 +48,10 @@ string DataWriter::ToString() const
 
 void DataWriter::Write(const DataNode &node)
 {
+	// If the node was loaded along with its comments, keep them.
+	for(const string &comment : node.Comments())
+		WriteComment(comment);
+
 	for(int i = 0; i < node.Size(); ++i)
 		WriteToken(node.Token(i).c_str());
 	Write();
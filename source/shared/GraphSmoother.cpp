@@ -0,0 +1,88 @@
+/* GraphSmoother.cpp
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "GraphSmoother.h"
+
+#include "SystemGraph.h"
+
+#include <cmath>
+
+using namespace std;
+
+
+
+GraphSmoother::GraphSmoother(const SystemGraph &graph, double damping, bool weightByDistance)
+	: graph(graph), damping(damping)
+{
+	const vector<int> &offsets = graph.Offsets();
+	const vector<int> &targets = graph.Targets();
+	weights.assign(targets.size(), 1.);
+	totals.assign(graph.Size(), 0.);
+	for(int i = 0; i < graph.Size(); ++i)
+		for(int e = offsets[i]; e < offsets[i + 1]; ++e)
+		{
+			if(weightByDistance)
+			{
+				// Systems in the same place would get an infinite weight, so
+				// treat them as being a tiny distance apart.
+				int j = targets[e];
+				double distance = hypot(graph.X(i) - graph.X(j), graph.Y(i) - graph.Y(j));
+				weights[e] = 1. / max(distance, 1.);
+			}
+			totals[i] += weights[e];
+		}
+}
+
+
+
+void GraphSmoother::Smooth(vector<double> &values, int columns, int passes) const
+{
+	const vector<int> &offsets = graph.Offsets();
+	const vector<int> &targets = graph.Targets();
+	const double keep = 1. - damping;
+
+	vector<double> next(values.size());
+	vector<double> sum(columns);
+	for(int pass = 0; pass < passes; ++pass)
+	{
+		for(int i = 0; i < graph.Size(); ++i)
+		{
+			const double *in = values.data() + static_cast<size_t>(i) * columns;
+			double *out = next.data() + static_cast<size_t>(i) * columns;
+			if(!totals[i])
+			{
+				for(int c = 0; c < columns; ++c)
+					out[c] = in[c];
+				continue;
+			}
+
+			for(int c = 0; c < columns; ++c)
+				sum[c] = 0.;
+			for(int e = offsets[i]; e < offsets[i + 1]; ++e)
+			{
+				const double *neighbor = values.data() + static_cast<size_t>(targets[e]) * columns;
+				const double weight = weights[e];
+				for(int c = 0; c < columns; ++c)
+					sum[c] += weight * neighbor[c];
+			}
+			// Only divide at the very end, so that if all the inputs are whole
+			// numbers, an exact half stays exact and rounds predictably.
+			const double total = totals[i];
+			for(int c = 0; c < columns; ++c)
+				out[c] = (keep * total * in[c] + damping * sum[c]) / total;
+		}
+		values.swap(next);
+	}
+}
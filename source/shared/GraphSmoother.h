@@ -0,0 +1,54 @@
+/* GraphSmoother.h
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef GRAPH_SMOOTHER_H_
+#define GRAPH_SMOOTHER_H_
+
+#include <vector>
+
+class SystemGraph;
+
+
+
+// Smooths out values attached to the systems of a map by repeatedly blending
+// each system's value with the weighted average of its neighbors' values. With
+// a damping factor d, each pass replaces a system's value x with (1 - d) x plus
+// d times that average, which amounts to a sparse matrix-vector product over the
+// system graph. Neighbors can be weighted equally, or by how short the link to
+// them is. Any number of quantities (for example, the prices of all commodities)
+// can be smoothed at once by storing them as the columns of a matrix with one
+// row per system; the innermost loop then runs over a row's contiguous columns,
+// which the compiler can turn into SIMD instructions.
+class GraphSmoother {
+public:
+	explicit GraphSmoother(const SystemGraph &graph, double damping = .5, bool weightByDistance = false);
+
+	// Smooth the given matrix of values in place. The values for system i are
+	// the `columns` entries starting at values[i * columns].
+	void Smooth(std::vector<double> &values, int columns, int passes = 1) const;
+
+
+private:
+	const SystemGraph &graph;
+	double damping;
+	// The weight of each link, in the same order as the graph's targets, and
+	// the sum of the weights of each system's links.
+	std::vector<double> weights;
+	std::vector<double> totals;
+};
+
+
+
+#endif
@@ -0,0 +1,64 @@
+/* HopDistance.cpp
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "HopDistance.h"
+
+using namespace std;
+
+
+
+HopDistance::HopDistance(const SystemGraph &graph, int maxDistance, size_t cacheLimit)
+	: graph(graph), maxDistance(maxDistance)
+{
+	// Cached distances take one byte each, so neighborhoods that reach any
+	// further than that are never cached.
+	if(maxDistance > MAX_CACHED_DISTANCE)
+		return;
+
+	// Search outwards from every system, giving up if it turns out that the
+	// neighborhoods are too big to cache.
+	Search search;
+	vector<size_t> newOffsets(1, 0);
+	for(int i = 0; i < graph.Size(); ++i)
+	{
+		ForEach(i, this->maxDistance, search, [this](int system, int distance)
+		{
+			systems.push_back(system);
+			distances.push_back(distance);
+		});
+		if(systems.size() > cacheLimit)
+		{
+			systems = vector<int>();
+			distances = vector<uint8_t>();
+			return;
+		}
+		newOffsets.push_back(systems.size());
+	}
+	offsets.swap(newOffsets);
+}
+
+
+
+bool HopDistance::IsCached() const
+{
+	return !offsets.empty();
+}
+
+
+
+int HopDistance::MaxDistance() const
+{
+	return maxDistance;
+}
@@ -0,0 +1,117 @@
+/* HopDistance.h
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef HOP_DISTANCE_H_
+#define HOP_DISTANCE_H_
+
+#include "SystemGraph.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+
+// Finds every system within a certain number of jumps of a given system. If the
+// map is small enough and the distance is at most 255 jumps, the neighborhood
+// of every system is found once up front and cached, sorted by distance. Otherwise, each query does a breadth-first
+// search that stops at the maximum distance. Rather than clearing its "visited"
+// flags after every search, it stamps each system with the number of the search
+// that visited it, so a system is unvisited if its stamp is out of date.
+class HopDistance {
+public:
+	// Working memory for searching a graph that is too big to cache. A search
+	// may not be shared between threads.
+	class Search {
+	public:
+		std::vector<unsigned> stamp;
+		unsigned epoch = 0;
+		std::vector<int> queue;
+		std::vector<int> distance;
+	};
+
+
+public:
+	// Neighborhoods are cached unless that would take more than the given
+	// number of entries in total.
+	HopDistance(const SystemGraph &graph, int maxDistance, size_t cacheLimit = 1 << 24);
+
+	bool IsCached() const;
+	int MaxDistance() const;
+
+	// Call f(system, distance) for the given system and every system within the
+	// given distance of it (which may not be more than the maximum), in order
+	// of increasing distance.
+	template <class F>
+	void ForEach(int source, int distance, Search &search, F f) const;
+
+
+private:
+	static const int MAX_CACHED_DISTANCE = 255;
+
+
+private:
+	const SystemGraph &graph;
+	int maxDistance;
+
+	// The cached neighborhoods, if any.
+	std::vector<size_t> offsets;
+	std::vector<int> systems;
+	std::vector<uint8_t> distances;
+};
+
+
+
+template <class F>
+void HopDistance::ForEach(int source, int distance, Search &search, F f) const
+{
+	if(IsCached())
+	{
+		for(size_t i = offsets[source]; i < offsets[source + 1] && distances[i] <= distance; ++i)
+			f(systems[i], static_cast<int>(distances[i]));
+		return;
+	}
+
+	// Start a new search. On the rare occasion that the stamp wraps around,
+	// everything must be cleared for real.
+	if(search.stamp.size() != static_cast<size_t>(graph.Size()) || !++search.epoch)
+	{
+		search.stamp.assign(graph.Size(), 0);
+		search.epoch = 1;
+	}
+	search.queue.assign(1, source);
+	search.distance.assign(1, 0);
+	search.stamp[source] = search.epoch;
+	for(size_t i = 0; i < search.queue.size(); ++i)
+	{
+		int system = search.queue[i];
+		int d = search.distance[i];
+		f(system, d);
+		if(d == distance)
+			continue;
+
+		for(int next : graph.Links(system))
+			if(search.stamp[next] != search.epoch)
+			{
+				search.stamp[next] = search.epoch;
+				search.queue.push_back(next);
+				search.distance.push_back(d + 1);
+			}
+	}
+}
+
+
+
+#endif
@@ -0,0 +1,266 @@
+/* Image.cpp
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Image.h"
+
+#include <png.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+using namespace std;
+
+
+
+Image::Image(int width, int height, uint32_t color)
+	: width(width), height(height), pixels(static_cast<size_t>(width) * height, color)
+{
+}
+
+
+
+bool Image::Read(const string &path)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if(!file)
+		return false;
+
+	// Set up libpng.
+	png_struct *png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	if(!png)
+	{
+		fclose(file);
+		return false;
+	}
+
+	png_info *info = png_create_info_struct(png);
+	if(!info)
+	{
+		png_destroy_read_struct(&png, nullptr, nullptr);
+		fclose(file);
+		return false;
+	}
+
+	if(setjmp(png_jmpbuf(png)))
+	{
+		png_destroy_read_struct(&png, &info, nullptr);
+		fclose(file);
+		width = 0;
+		height = 0;
+		pixels.clear();
+		return false;
+	}
+
+	png_init_io(png, file);
+	png_set_sig_bytes(png, 0);
+
+	png_read_info(png, info);
+	width = png_get_image_width(png, info);
+	height = png_get_image_height(png, info);
+	if(!width || !height)
+		png_error(png, "empty image");
+
+	// Adjust settings to make sure the result will be a BGRA file.
+	int colorType = png_get_color_type(png, info);
+	int bitDepth = png_get_bit_depth(png, info);
+
+	png_set_strip_16(png);
+	png_set_packing(png);
+	if(colorType == PNG_COLOR_TYPE_PALETTE)
+		png_set_palette_to_rgb(png);
+	if(colorType == PNG_COLOR_TYPE_GRAY && bitDepth < 8)
+		png_set_expand_gray_1_2_4_to_8(png);
+	if(!(colorType & PNG_COLOR_MASK_COLOR))
+		png_set_gray_to_rgb(png);
+	if(png_get_valid(png, info, PNG_INFO_tRNS))
+		png_set_tRNS_to_alpha(png);
+	else if(!(colorType & PNG_COLOR_MASK_ALPHA))
+		png_set_add_alpha(png, 0xFF, PNG_FILLER_AFTER);
+	png_set_bgr(png);
+	png_read_update_info(png, info);
+
+	// Read the file.
+	pixels.resize(static_cast<size_t>(width) * height);
+	vector<png_byte *> rows;
+	for(int y = 0; y < height; ++y)
+		rows.push_back(reinterpret_cast<png_byte *>(pixels.data() + static_cast<size_t>(y) * width));
+
+	png_read_image(png, rows.data());
+
+	// Clean up.
+	png_destroy_read_struct(&png, &info, nullptr);
+	fclose(file);
+
+	return true;
+}
+
+
+
+bool Image::Write(const string &path, int compression) const
+{
+	if(pixels.empty())
+		return false;
+
+	FILE *file = fopen(path.c_str(), "wb");
+	if(!file)
+		return false;
+
+	// Set up libpng.
+	png_struct *png = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+	if(!png)
+	{
+		fclose(file);
+		return false;
+	}
+
+	png_info *info = png_create_info_struct(png);
+	if(!info)
+	{
+		png_destroy_write_struct(&png, nullptr);
+		fclose(file);
+		return false;
+	}
+
+	if(setjmp(png_jmpbuf(png)))
+	{
+		png_destroy_write_struct(&png, &info);
+		fclose(file);
+		return false;
+	}
+
+	png_init_io(png, file);
+	png_set_compression_level(png, compression);
+	// Trying every filter on every row takes longer than the compression
+	// itself does at the fastest levels, and gains little for flat images.
+	if(compression <= 3)
+		png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+
+	png_set_IHDR(png, info, width, height, 8,
+		PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
+		PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+
+	png_set_bgr(png);
+	png_write_info(png, info);
+
+	vector<png_byte *> rows;
+	for(int y = 0; y < height; ++y)
+		rows.push_back(const_cast<png_byte *>(reinterpret_cast<const png_byte *>(
+			pixels.data() + static_cast<size_t>(y) * width)));
+
+	png_write_image(png, rows.data());
+	png_write_end(png, nullptr);
+
+	// Clean up.
+	png_destroy_write_struct(&png, &info);
+	return !fclose(file);
+}
+
+
+
+Image Image::Shrink(int newWidth, int newHeight) const
+{
+	Image result(max(1, newWidth), max(1, newHeight));
+	if(pixels.empty())
+		return result;
+	newWidth = result.width;
+	newHeight = result.height;
+
+	// The filter is done in two passes: first each new row is made by adding
+	// up the old rows it covers, then each new pixel by adding up the columns
+	// of that row that it covers. Colors are multiplied by alpha before they
+	// are averaged, so that transparent pixels do not darken their neighbors.
+	// The inner loop of the first pass runs over a whole row of floats, so the
+	// compiler can turn it into SIMD instructions.
+	vector<float> source(static_cast<size_t>(width) * 4);
+	vector<float> row(static_cast<size_t>(width) * 4);
+	const double yScale = static_cast<double>(height) / newHeight;
+	const double xScale = static_cast<double>(width) / newWidth;
+	for(int y = 0; y < newHeight; ++y)
+	{
+		fill(row.begin(), row.end(), 0.f);
+		const double top = y * yScale;
+		const double bottom = (y + 1) * yScale;
+		for(int sy = floor(top); sy < min<double>(height, ceil(bottom)); ++sy)
+		{
+			const float weight = min<double>(bottom, sy + 1) - max<double>(top, sy);
+			const uint32_t *in = pixels.data() + static_cast<size_t>(sy) * width;
+			for(int x = 0; x < width; ++x)
+			{
+				const float alpha = in[x] >> 24;
+				source[4 * x] = (in[x] & 0xFF) * alpha;
+				source[4 * x + 1] = ((in[x] >> 8) & 0xFF) * alpha;
+				source[4 * x + 2] = ((in[x] >> 16) & 0xFF) * alpha;
+				source[4 * x + 3] = alpha;
+			}
+			const float *from = source.data();
+			float *to = row.data();
+			const int count = width * 4;
+			for(int i = 0; i < count; ++i)
+				to[i] += weight * from[i];
+		}
+
+		uint32_t *out = result.pixels.data() + static_cast<size_t>(y) * newWidth;
+		for(int x = 0; x < newWidth; ++x)
+		{
+			const double left = x * xScale;
+			const double right = (x + 1) * xScale;
+			float sum[4] = {0.f, 0.f, 0.f, 0.f};
+			for(int sx = floor(left); sx < min<double>(width, ceil(right)); ++sx)
+			{
+				const float weight = min<double>(right, sx + 1) - max<double>(left, sx);
+				for(int c = 0; c < 4; ++c)
+					sum[c] += weight * row[4 * sx + c];
+			}
+			// Undo the multiplication by alpha, and divide by the area covered.
+			const float area = xScale * yScale;
+			const float alpha = sum[3] / area;
+			uint32_t pixel = static_cast<uint32_t>(min(255.f, alpha + .5f)) << 24;
+			if(sum[3] > 0.f)
+				for(int c = 0; c < 3; ++c)
+					pixel |= static_cast<uint32_t>(min(255.f, sum[c] / sum[3] + .5f)) << (8 * c);
+			out[x] = pixel;
+		}
+	}
+	return result;
+}
+
+
+
+int Image::Width() const
+{
+	return width;
+}
+
+
+
+int Image::Height() const
+{
+	return height;
+}
+
+
+
+uint32_t *Image::Pixels()
+{
+	return pixels.data();
+}
+
+
+
+const uint32_t *Image::Pixels() const
+{
+	return pixels.data();
+}
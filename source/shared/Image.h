@@ -0,0 +1,58 @@
+/* Image.h
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef IMAGE_H_
+#define IMAGE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+
+// An image in memory. Each pixel is a 32-bit value holding its alpha, red,
+// green and blue components, from the most significant byte to the least (so
+// in memory, on a little-endian machine, the bytes are in BGRA order). Images
+// can be read from and written to PNG files using libpng.
+class Image {
+public:
+	Image() = default;
+	Image(int width, int height, uint32_t color = 0);
+
+	// Read a PNG file of any color type. Returns false if it cannot be read.
+	bool Read(const std::string &path);
+	// Write a PNG file, with the given zlib compression level (0 to 9).
+	bool Write(const std::string &path, int compression = 9) const;
+
+	// Get a copy of this image scaled down to the given size. Each new pixel is
+	// the average of the old pixels it covers (a "box filter"), weighted by how
+	// much of each one it covers and by their alpha.
+	Image Shrink(int width, int height) const;
+
+	int Width() const;
+	int Height() const;
+	uint32_t *Pixels();
+	const uint32_t *Pixels() const;
+
+
+private:
+	int width = 0;
+	int height = 0;
+	std::vector<uint32_t> pixels;
+};
+
+
+
+#endif
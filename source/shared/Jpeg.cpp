@@ -0,0 +1,142 @@
+/* Jpeg.cpp
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Jpeg.h"
+
+#include "Image.h"
+
+#include <csetjmp>
+#include <cstdio>
+#include <vector>
+
+// libjpeg needs stdio to be included first.
+#include <jpeglib.h>
+
+using namespace std;
+
+namespace {
+	// By default, libjpeg exits the program when it finds an error. Jump back
+	// out of it instead, so that the error can be reported.
+	class ErrorManager {
+	public:
+		jpeg_error_mgr manager;
+		jmp_buf jump;
+	};
+
+	void OnError(j_common_ptr info)
+	{
+		longjmp(reinterpret_cast<ErrorManager *>(info->err)->jump, 1);
+	}
+}
+
+
+
+bool Jpeg::Read(const string &path, Image &image)
+{
+	FILE *file = fopen(path.c_str(), "rb");
+	if(!file)
+		return false;
+
+	// Anything that must be cleaned up after an error has to exist before the
+	// point that the error jumps back to.
+	Image result;
+	vector<JSAMPLE> row;
+	jpeg_decompress_struct info;
+	ErrorManager error;
+	info.err = jpeg_std_error(&error.manager);
+	error.manager.error_exit = OnError;
+	if(setjmp(error.jump))
+	{
+		jpeg_destroy_decompress(&info);
+		fclose(file);
+		return false;
+	}
+
+	jpeg_create_decompress(&info);
+	jpeg_stdio_src(&info, file);
+	jpeg_read_header(&info, true);
+	info.out_color_space = JCS_RGB;
+	jpeg_start_decompress(&info);
+
+	const int width = info.output_width;
+	const int height = info.output_height;
+	result = Image(width, height);
+	row.resize(static_cast<size_t>(width) * 3);
+	JSAMPROW rows[1] = {row.data()};
+	while(info.output_scanline < info.output_height)
+	{
+		uint32_t *out = result.Pixels() + static_cast<size_t>(info.output_scanline) * width;
+		jpeg_read_scanlines(&info, rows, 1);
+		for(int x = 0; x < width; ++x)
+			out[x] = 0xFF000000 | (row[3 * x] << 16) | (row[3 * x + 1] << 8) | row[3 * x + 2];
+	}
+
+	jpeg_finish_decompress(&info);
+	jpeg_destroy_decompress(&info);
+	fclose(file);
+	image = move(result);
+	return true;
+}
+
+
+
+bool Jpeg::Write(const string &path, const Image &image, int quality)
+{
+	if(!image.Width() || !image.Height())
+		return false;
+	FILE *file = fopen(path.c_str(), "wb");
+	if(!file)
+		return false;
+
+	vector<JSAMPLE> row(static_cast<size_t>(image.Width()) * 3);
+	jpeg_compress_struct info;
+	ErrorManager error;
+	info.err = jpeg_std_error(&error.manager);
+	error.manager.error_exit = OnError;
+	if(setjmp(error.jump))
+	{
+		jpeg_destroy_compress(&info);
+		fclose(file);
+		return false;
+	}
+
+	jpeg_create_compress(&info);
+	jpeg_stdio_dest(&info, file);
+	info.image_width = image.Width();
+	info.image_height = image.Height();
+	info.input_components = 3;
+	info.in_color_space = JCS_RGB;
+	jpeg_set_defaults(&info);
+	jpeg_set_quality(&info, quality, true);
+	jpeg_start_compress(&info, true);
+
+	const int width = image.Width();
+	JSAMPROW rows[1] = {row.data()};
+	while(info.next_scanline < info.image_height)
+	{
+		const uint32_t *in = image.Pixels() + static_cast<size_t>(info.next_scanline) * width;
+		for(int x = 0; x < width; ++x)
+		{
+			row[3 * x] = (in[x] >> 16) & 0xFF;
+			row[3 * x + 1] = (in[x] >> 8) & 0xFF;
+			row[3 * x + 2] = in[x] & 0xFF;
+		}
+		jpeg_write_scanlines(&info, rows, 1);
+	}
+
+	jpeg_finish_compress(&info);
+	jpeg_destroy_compress(&info);
+	return !fclose(file);
+}
@@ -0,0 +1,39 @@
+/* Jpeg.h
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef JPEG_H_
+#define JPEG_H_
+
+#include <string>
+
+class Image;
+
+
+
+// Reads and writes JPEG files, like the landscapes, using libjpeg. This is kept
+// apart from Image so that only the programs that need JPEG files have to link
+// to libjpeg.
+class Jpeg {
+public:
+	// Read a JPEG file into the given image. Returns false if it cannot be read.
+	static bool Read(const std::string &path, Image &image);
+	// Write an image as a JPEG file, with the given quality (0 to 100). Any
+	// alpha channel is ignored.
+	static bool Write(const std::string &path, const Image &image, int quality = 85);
+};
+
+
+
+#endif
@@ -0,0 +1,145 @@
+/* Raster.cpp
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Raster.h"
+
+#include "Image.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+
+
+Raster::Raster(Image &image, double left, double top, double scale)
+	: image(image), left(left), top(top), scale(scale)
+{
+}
+
+
+
+uint32_t Raster::Color(double r, double g, double b)
+{
+	auto channel = [](double value) -> uint32_t
+	{
+		return lround(255. * max(0., min(1., value)));
+	};
+	return 0xFF000000u | (channel(r) << 16) | (channel(g) << 8) | channel(b);
+}
+
+
+
+void Raster::Fill(uint32_t color)
+{
+	fill(image.Pixels(), image.Pixels() + static_cast<size_t>(image.Width()) * image.Height(), color);
+}
+
+
+
+void Raster::Line(double x1, double y1, double x2, double y2, double width, uint32_t color)
+{
+	// Work in pixels, with each pixel's center at a half-integer position.
+	x1 = (x1 - left) * scale;
+	y1 = (y1 - top) * scale;
+	x2 = (x2 - left) * scale;
+	y2 = (y2 - top) * scale;
+	const double halfWidth = .5 * width;
+	const double reach = halfWidth + .5;
+	if(max(x1, x2) + reach < 0. || min(x1, x2) - reach > image.Width()
+			|| max(y1, y2) + reach < 0. || min(y1, y2) - reach > image.Height())
+		return;
+
+	// Step along whichever axis the line is longer in, so that each pixel near
+	// the line is only visited once and only a narrow band around it is visited
+	// at all, no matter how the line is oriented. Each pixel's coverage comes
+	// from its distance to the nearest point on the line.
+	const double dx = x2 - x1;
+	const double dy = y2 - y1;
+	const double lengthSquared = dx * dx + dy * dy;
+	const bool steep = fabs(dy) > fabs(dx);
+	// The coordinates along and across the axis being stepped along.
+	const double a1 = steep ? y1 : x1;
+	const double a2 = steep ? y2 : x2;
+	const double b1 = steep ? x1 : y1;
+	const double b2 = steep ? x2 : y2;
+	const int aLimit = steep ? image.Height() : image.Width();
+	const int bLimit = steep ? image.Width() : image.Height();
+	// How far across the axis the band of pixels near the line extends.
+	const double band = lengthSquared ? reach * sqrt(lengthSquared) / max(fabs(a2 - a1), 1e-9) : reach;
+
+	int aFirst = max(0, static_cast<int>(floor(min(a1, a2) - reach)));
+	int aLast = min(aLimit - 1, static_cast<int>(ceil(max(a1, a2) + reach)));
+	for(int a = aFirst; a <= aLast; ++a)
+	{
+		double center = a + .5;
+		double t = (a2 != a1) ? (center - a1) / (a2 - a1) : 0.;
+		t = max(0., min(1., t));
+		double b = b1 + t * (b2 - b1);
+		int bFirst = max(0, static_cast<int>(floor(b - band)));
+		int bLast = min(bLimit - 1, static_cast<int>(ceil(b + band)));
+		for(int bb = bFirst; bb <= bLast; ++bb)
+		{
+			double px = steep ? bb + .5 : center;
+			double py = steep ? center : bb + .5;
+			double u = lengthSquared ? ((px - x1) * dx + (py - y1) * dy) / lengthSquared : 0.;
+			u = max(0., min(1., u));
+			double ex = px - (x1 + u * dx);
+			double ey = py - (y1 + u * dy);
+			double coverage = min(1., reach - sqrt(ex * ex + ey * ey));
+			if(coverage > 0.)
+				Blend(steep ? bb : a, steep ? a : bb, coverage, color);
+		}
+	}
+}
+
+
+
+void Raster::Circle(double x, double y, double radius, uint32_t color)
+{
+	x = (x - left) * scale;
+	y = (y - top) * scale;
+	const double reach = radius + .5;
+	int xFirst = max(0, static_cast<int>(floor(x - reach)));
+	int xLast = min(image.Width() - 1, static_cast<int>(ceil(x + reach)));
+	int yFirst = max(0, static_cast<int>(floor(y - reach)));
+	int yLast = min(image.Height() - 1, static_cast<int>(ceil(y + reach)));
+	for(int py = yFirst; py <= yLast; ++py)
+		for(int px = xFirst; px <= xLast; ++px)
+		{
+			double ex = px + .5 - x;
+			double ey = py + .5 - y;
+			double coverage = min(1., reach - sqrt(ex * ex + ey * ey));
+			if(coverage > 0.)
+				Blend(px, py, coverage, color);
+		}
+}
+
+
+
+void Raster::Blend(int x, int y, double coverage, uint32_t color)
+{
+	uint32_t &pixel = image.Pixels()[static_cast<size_t>(y) * image.Width() + x];
+	// Blend in fixed point, with the coverage as a fraction of 256.
+	const int32_t weight = coverage * 256. + .5;
+	uint32_t result = pixel & 0xFF000000u;
+	for(int shift = 0; shift < 24; shift += 8)
+	{
+		int32_t from = (pixel >> shift) & 0xFF;
+		int32_t to = (color >> shift) & 0xFF;
+		result |= static_cast<uint32_t>(from + (((to - from) * weight + 128) >> 8)) << shift;
+	}
+	pixel = result;
+}
@@ -0,0 +1,63 @@
+/* Raster.h
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RASTER_H_
+#define RASTER_H_
+
+#include <cstdint>
+
+class Image;
+
+
+
+// Draws anti-aliased shapes into an Image. Positions are given in "world"
+// coordinates, which are mapped to pixels by subtracting the world position of
+// the image's top left corner and multiplying by a scale, so the same drawing
+// code can render a whole map or any one tile of a zoomed-in view of it. Sizes,
+// on the other hand, are always given in pixels. Rather than sampling each
+// pixel several times, the fraction of a pixel that a shape covers is estimated
+// from the distance between the pixel's center and the shape's edge, and only
+// the pixels near a shape are ever looked at, so anything outside the image
+// costs almost nothing to draw.
+class Raster {
+public:
+	Raster(Image &image, double left = 0., double top = 0., double scale = 1.);
+
+	// Pack a color, with components from 0 to 1, into a pixel value.
+	static uint32_t Color(double r, double g, double b);
+
+	void Fill(uint32_t color);
+	// Draw a line with round ends.
+	void Line(double x1, double y1, double x2, double y2, double width, uint32_t color);
+	// Draw a filled circle.
+	void Circle(double x, double y, double radius, uint32_t color);
+
+
+private:
+	// Blend the given color into the given pixel, covering the given fraction
+	// of it. Coordinates must be inside the image.
+	void Blend(int x, int y, double coverage, uint32_t color);
+
+
+private:
+	Image &image;
+	double left;
+	double top;
+	double scale;
+};
+
+
+
+#endif
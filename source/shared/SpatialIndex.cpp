@@ -0,0 +1,218 @@
+/* SpatialIndex.cpp
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "SpatialIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <utility>
+
+using namespace std;
+
+
+
+int SpatialIndex::Add(double x, double y)
+{
+	this->x.push_back(x);
+	this->y.push_back(y);
+	return this->x.size() - 1;
+}
+
+
+
+void SpatialIndex::Finish()
+{
+	const int count = x.size();
+	columns = 0;
+	rows = 0;
+	offsets.assign(1, 0);
+	points.clear();
+	if(!count)
+		return;
+
+	auto xRange = minmax_element(x.begin(), x.end());
+	auto yRange = minmax_element(y.begin(), y.end());
+	left = *xRange.first;
+	top = *yRange.first;
+	double width = *xRange.second - left;
+	double height = *yRange.second - top;
+
+	// Aim for about one point per cell, but if the points are all in a line (or
+	// all in the same place) the area is zero, so base the size on the length
+	// instead. That also keeps a long, thin map from having far more cells than
+	// points.
+	cellSize = sqrt(width * height / count);
+	cellSize = max(cellSize, max(width, height) / count);
+	if(!(cellSize > 0.))
+		cellSize = 1.;
+	columns = static_cast<int>(width / cellSize) + 1;
+	rows = static_cast<int>(height / cellSize) + 1;
+
+	// Count the points in each cell, then place each one after the points in
+	// the cells before it.
+	vector<int> cells(count);
+	offsets.assign(static_cast<size_t>(columns) * rows + 1, 0);
+	for(int i = 0; i < count; ++i)
+	{
+		cells[i] = Row(y[i]) * columns + Column(x[i]);
+		++offsets[cells[i] + 1];
+	}
+	for(size_t c = 1; c < offsets.size(); ++c)
+		offsets[c] += offsets[c - 1];
+	vector<int> next(offsets.begin(), offsets.end() - 1);
+	points.resize(count);
+	for(int i = 0; i < count; ++i)
+		points[next[cells[i]]++] = i;
+}
+
+
+
+int SpatialIndex::Size() const
+{
+	return x.size();
+}
+
+
+
+double SpatialIndex::X(int index) const
+{
+	return x[index];
+}
+
+
+
+double SpatialIndex::Y(int index) const
+{
+	return y[index];
+}
+
+
+
+vector<int> SpatialIndex::InRect(double left, double top, double right, double bottom) const
+{
+	vector<int> result;
+	if(!columns || right < left || bottom < top)
+		return result;
+
+	const int lastColumn = Column(right);
+	const int lastRow = Row(bottom);
+	for(int row = Row(top); row <= lastRow; ++row)
+		for(int column = Column(left); column <= lastColumn; ++column)
+		{
+			const int cell = row * columns + column;
+			for(int e = offsets[cell]; e < offsets[cell + 1]; ++e)
+			{
+				int i = points[e];
+				if(x[i] >= left && x[i] <= right && y[i] >= top && y[i] <= bottom)
+					result.push_back(i);
+			}
+		}
+	sort(result.begin(), result.end());
+	return result;
+}
+
+
+
+vector<int> SpatialIndex::InRadius(double x, double y, double radius) const
+{
+	vector<int> result = InRect(x - radius, y - radius, x + radius, y + radius);
+	const double limit = radius * radius;
+	auto outside = [&](int i)
+	{
+		double dx = this->x[i] - x;
+		double dy = this->y[i] - y;
+		return dx * dx + dy * dy > limit;
+	};
+	result.erase(remove_if(result.begin(), result.end(), outside), result.end());
+	return result;
+}
+
+
+
+vector<int> SpatialIndex::Nearest(double x, double y, int k) const
+{
+	k = min(k, Size());
+	if(k <= 0)
+		return vector<int>();
+
+	// Search outward from the cell the point is in, one ring of cells at a time,
+	// keeping the k closest points seen so far with the farthest on top. Every
+	// cell beyond ring r is at least r cells away, so once the farthest of those
+	// k points is closer than that, no other point can be any closer.
+	priority_queue<pair<double, int>> closest;
+	const int centerColumn = Column(x);
+	const int centerRow = Row(y);
+	const int lastRing = max(max(centerColumn, columns - 1 - centerColumn), max(centerRow, rows - 1 - centerRow));
+	for(int ring = 0; ring <= lastRing; ++ring)
+	{
+		if(static_cast<int>(closest.size()) == k)
+		{
+			double reach = (ring - 1) * cellSize;
+			if(reach > 0. && closest.top().first < reach * reach)
+				break;
+		}
+		for(int row = max(0, centerRow - ring); row <= min(rows - 1, centerRow + ring); ++row)
+		{
+			// Only the cells on the edge of the ring are new.
+			bool isEdge = (row == centerRow - ring || row == centerRow + ring);
+			int step = isEdge ? 1 : 2 * ring;
+			for(int column = centerColumn - ring; column <= centerColumn + ring; column += max(1, step))
+			{
+				if(column < 0 || column >= columns)
+					continue;
+				const int cell = row * columns + column;
+				for(int e = offsets[cell]; e < offsets[cell + 1]; ++e)
+				{
+					int i = points[e];
+					double dx = this->x[i] - x;
+					double dy = this->y[i] - y;
+					pair<double, int> candidate(dx * dx + dy * dy, i);
+					if(static_cast<int>(closest.size()) < k)
+						closest.push(candidate);
+					else if(candidate < closest.top())
+					{
+						closest.pop();
+						closest.push(candidate);
+					}
+				}
+			}
+		}
+	}
+
+	vector<int> result(closest.size());
+	for(int i = result.size() - 1; i >= 0; --i)
+	{
+		result[i] = closest.top().second;
+		closest.pop();
+	}
+	return result;
+}
+
+
+
+int SpatialIndex::Column(double x) const
+{
+	double column = floor((x - left) / cellSize);
+	return (column >= columns) ? columns - 1 : (column > 0.) ? static_cast<int>(column) : 0;
+}
+
+
+
+int SpatialIndex::Row(double y) const
+{
+	double row = floor((y - top) / cellSize);
+	return (row >= rows) ? rows - 1 : (row > 0.) ? static_cast<int>(row) : 0;
+}
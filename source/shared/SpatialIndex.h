@@ -0,0 +1,76 @@
+/* SpatialIndex.h
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SPATIAL_INDEX_H_
+#define SPATIAL_INDEX_H_
+
+#include <vector>
+
+
+
+// A uniform grid over a set of points, for finding the points in a given area or
+// nearest to a given place without checking every one of them. The grid has
+// about one cell per point, and the points in each cell are stored together in
+// one flat array, in the same "compressed sparse row" form as the links in a
+// SystemGraph. A query only has to look at the cells that overlap the area it is
+// asking about, so finding the few systems on the screen in a map of a hundred
+// thousand systems takes microseconds. Points are numbered in the order they are
+// added, and every query returns those numbers.
+class SpatialIndex {
+public:
+	// Add a point, and return its index.
+	int Add(double x, double y);
+	// Build the grid. This must be done after adding points and before making
+	// any queries.
+	void Finish();
+
+	int Size() const;
+	double X(int index) const;
+	double Y(int index) const;
+
+	// Find every point inside the given rectangle or on its edges, in order.
+	std::vector<int> InRect(double left, double top, double right, double bottom) const;
+	// Find every point within the given distance of (x, y), in order.
+	std::vector<int> InRadius(double x, double y, double radius) const;
+	// Find the k points closest to (x, y), closest first. Points at exactly the
+	// same distance are given in order.
+	std::vector<int> Nearest(double x, double y, int k) const;
+
+
+private:
+	// Get the column or row that the given coordinate falls in, clamped to the
+	// edges of the grid.
+	int Column(double x) const;
+	int Row(double y) const;
+
+
+private:
+	std::vector<double> x;
+	std::vector<double> y;
+
+	double left = 0.;
+	double top = 0.;
+	double cellSize = 1.;
+	int columns = 0;
+	int rows = 0;
+	// The points in cell c are points[offsets[c]] to points[offsets[c + 1] - 1].
+	// Cells are numbered row by row.
+	std::vector<int> offsets;
+	std::vector<int> points;
+};
+
+
+
+#endif
@@ -0,0 +1,302 @@
+/* SvgWriter.cpp
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "SvgWriter.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace {
+	// How much output to collect before writing it out.
+	const size_t BLOCK_SIZE = 1 << 16;
+}
+
+
+
+SvgWriter::SvgWriter(const string &path, int precision)
+	: precision(precision), factor(pow(10., precision))
+{
+	const string GZIP = ".svgz";
+	if(path.size() >= GZIP.size() && !path.compare(path.size() - GZIP.size(), GZIP.size(), GZIP))
+		gz = gzopen(path.c_str(), "wb6");
+	else
+	{
+		file.open(path, ios::binary);
+		if(file)
+			out = &file;
+	}
+}
+
+
+
+SvgWriter::SvgWriter(ostream &out, int precision)
+	: out(&out), precision(precision), factor(pow(10., precision))
+{
+}
+
+
+
+SvgWriter::~SvgWriter()
+{
+	Close();
+}
+
+
+
+bool SvgWriter::IsOpen() const
+{
+	return out || gz;
+}
+
+
+
+void SvgWriter::Begin(double width, double height, const string &attributes)
+{
+	buffer += "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"";
+	Number(buffer, width);
+	buffer += "\" height=\"";
+	Number(buffer, height);
+	buffer += '"';
+	if(!attributes.empty())
+		buffer += ' ' + attributes;
+	buffer += ">\n";
+}
+
+
+
+void SvgWriter::Line(double x1, double y1, double x2, double y2, const string &style)
+{
+	// Round the ends first, so that the relative position of the second end is
+	// exact and no error builds up.
+	int64_t qx1 = Quantize(x1);
+	int64_t qy1 = Quantize(y1);
+	int64_t dx = Quantize(x2) - qx1;
+	int64_t dy = Quantize(y2) - qy1;
+	// A minus sign also separates two numbers.
+	string &data = Lines(style);
+	data += 'M';
+	Number(data, qx1);
+	if(qy1 >= 0)
+		data += ' ';
+	Number(data, qy1);
+	data += 'l';
+	Number(data, dx);
+	if(dy >= 0)
+		data += ' ';
+	Number(data, dy);
+}
+
+
+
+void SvgWriter::Circle(double x, double y, double radius, const string &style)
+{
+	FlushLines();
+	buffer += "<circle cx=\"";
+	Number(buffer, x);
+	buffer += "\" cy=\"";
+	Number(buffer, y);
+	buffer += "\" r=\"";
+	Number(buffer, radius);
+	buffer += "\" " + style + "/>\n";
+	Flush();
+}
+
+
+
+void SvgWriter::Dot(double x, double y, const string &style)
+{
+	int64_t qy = Quantize(y);
+	string &data = Lines(style);
+	data += 'M';
+	Number(data, Quantize(x));
+	if(qy >= 0)
+		data += ' ';
+	Number(data, qy);
+	data += "h0";
+}
+
+
+
+void SvgWriter::Rect(double x, double y, double width, double height, const string &style)
+{
+	FlushLines();
+	buffer += "<rect x=\"";
+	Number(buffer, x);
+	buffer += "\" y=\"";
+	Number(buffer, y);
+	buffer += "\" width=\"";
+	Number(buffer, width);
+	buffer += "\" height=\"";
+	Number(buffer, height);
+	buffer += "\" " + style + "/>\n";
+	Flush();
+}
+
+
+
+void SvgWriter::Raw(const string &text)
+{
+	FlushLines();
+	buffer += text;
+	Flush();
+}
+
+
+
+bool SvgWriter::Close()
+{
+	if(isClosed)
+		return !failed;
+	isClosed = true;
+
+	FlushLines();
+	buffer += "</svg>\n";
+	Flush(true);
+	if(gz)
+	{
+		failed |= (gzclose(gz) != Z_OK);
+		gz = nullptr;
+	}
+	else if(out)
+	{
+		failed |= !out->flush();
+		if(file.is_open())
+		{
+			file.close();
+			failed |= !file;
+		}
+	}
+	else
+		failed = true;
+	return !failed;
+}
+
+
+
+string SvgWriter::Color(double r, double g, double b)
+{
+	const char *HEX = "0123456789ABCDEF";
+	int value[3];
+	bool isShort = true;
+	int i = 0;
+	for(double component : {r, g, b})
+	{
+		value[i] = lround(255. * max(0., min(1., component)));
+		isShort &= (value[i] % 17 == 0);
+		++i;
+	}
+
+	string result = "#";
+	for(int component : value)
+	{
+		if(isShort)
+			result += HEX[component / 17];
+		else
+		{
+			result += HEX[component >> 4];
+			result += HEX[component & 15];
+		}
+	}
+	return result;
+}
+
+
+
+string &SvgWriter::Lines(const string &style)
+{
+	auto it = lines.begin();
+	while(it != lines.end() && it->first != style)
+		++it;
+	if(it == lines.end())
+		it = lines.emplace(it, style, string());
+	return it->second;
+}
+
+
+
+void SvgWriter::FlushLines()
+{
+	for(pair<string, string> &it : lines)
+	{
+		buffer += "<path " + it.first + " d=\"";
+		buffer += it.second;
+		buffer += "\"/>\n";
+		Flush();
+	}
+	lines.clear();
+}
+
+
+
+void SvgWriter::Number(string &out, double value) const
+{
+	Number(out, Quantize(value));
+}
+
+
+
+// Write a quantized value, leaving out any trailing zeros after the decimal
+// point, the point itself if nothing is left after it, and the zero before the
+// point if there is anything after it.
+void SvgWriter::Number(string &out, int64_t value) const
+{
+	if(value < 0)
+	{
+		out += '-';
+		value = -value;
+	}
+	char digits[24];
+	int length = 0;
+	do {
+		digits[length++] = '0' + value % 10;
+		value /= 10;
+	} while(value || length <= precision);
+
+	int end = 0;
+	while(end < precision && digits[end] == '0')
+		++end;
+	bool skipZero = (length == precision + 1 && digits[precision] == '0' && end < precision);
+	for(int i = length - 1; i >= precision + skipZero; --i)
+		out += digits[i];
+	if(end < precision)
+	{
+		out += '.';
+		for(int i = precision - 1; i >= end; --i)
+			out += digits[i];
+	}
+}
+
+
+
+int64_t SvgWriter::Quantize(double value) const
+{
+	return llround(value * factor);
+}
+
+
+
+void SvgWriter::Flush(bool force)
+{
+	if(buffer.size() < BLOCK_SIZE && !force)
+		return;
+
+	if(gz)
+		failed |= (!buffer.empty() && gzwrite(gz, buffer.data(), buffer.size()) != static_cast<int>(buffer.size()));
+	else if(out)
+		failed |= !out->write(buffer.data(), buffer.size());
+	buffer.clear();
+}
@@ -0,0 +1,102 @@
+/* SvgWriter.h
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SVG_WRITER_H_
+#define SVG_WRITER_H_
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+
+// Writes compact SVG files. All the lines drawn in the same style are gathered
+// up and written as a single <path> element, instead of one <line> each, and
+// every coordinate is rounded to a fixed number of decimal places (by default,
+// a tenth of a unit, which for a map drawn in pixels is far finer than anyone
+// can see). The second end of each line is written relative to the first, which
+// takes fewer digits. Output is collected in a buffer and written out in large
+// blocks rather than one element at a time, and if the file name ends in
+// ".svgz", it is compressed with zlib as it is written.
+// Any pending lines are written out before the next element of another kind,
+// so elements are still drawn in the order they were given, except that lines
+// in different styles are drawn in the order each style was first used.
+class SvgWriter {
+public:
+	explicit SvgWriter(const std::string &path, int precision = 1);
+	explicit SvgWriter(std::ostream &out, int precision = 1);
+	~SvgWriter();
+
+	SvgWriter(const SvgWriter &) = delete;
+	SvgWriter &operator=(const SvgWriter &) = delete;
+
+	bool IsOpen() const;
+
+	// Start the document. The attributes, if any, are added to the <svg> tag.
+	void Begin(double width, double height, const std::string &attributes = "");
+	// Each style is the text of the attributes to give the element, for example
+	// 'stroke="#666"'.
+	void Line(double x1, double y1, double x2, double y2, const std::string &style);
+	void Circle(double x, double y, double radius, const std::string &style);
+	// Add a dot to be drawn along with the lines. A dot is a line of no length
+	// with round ends, so its style must give its color and diameter as the
+	// stroke and stroke-width and set stroke-linecap="round". This is far more
+	// compact than a circle when many dots share a style.
+	void Dot(double x, double y, const std::string &style);
+	void Rect(double x, double y, double width, double height, const std::string &style);
+	// Write any other markup exactly as given.
+	void Raw(const std::string &text);
+	// Finish the document. Returns false if anything could not be written.
+	bool Close();
+
+	// Get a color as a hexadecimal string, like "#FC3" or "#6699FF", given
+	// components from 0 to 1.
+	static std::string Color(double r, double g, double b);
+
+
+private:
+	// Find the path data for the given style of line.
+	std::string &Lines(const std::string &style);
+	void FlushLines();
+	// Append a coordinate, rounded to the given precision.
+	void Number(std::string &out, double value) const;
+	void Number(std::string &out, int64_t value) const;
+	int64_t Quantize(double value) const;
+	// Write the buffer out once it is big enough, or if asked to.
+	void Flush(bool force = false);
+
+
+private:
+	std::ofstream file;
+	std::ostream *out = nullptr;
+	gzFile gz = nullptr;
+	bool failed = false;
+	bool isClosed = false;
+
+	int precision;
+	double factor;
+	std::string buffer;
+	// The path data for each style of line, in the order they were first used.
+	std::vector<std::pair<std::string, std::string>> lines;
+};
+
+
+
+#endif
@@ -0,0 +1,198 @@
+/* SystemGraph.cpp
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "SystemGraph.h"
+
+#include "DataFile.h"
+#include "DataNode.h"
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+
+using namespace std;
+
+
+
+const int *SystemGraph::Neighbors::begin() const
+{
+	return first;
+}
+
+
+
+const int *SystemGraph::Neighbors::end() const
+{
+	return last;
+}
+
+
+
+int SystemGraph::Neighbors::Size() const
+{
+	return last - first;
+}
+
+
+
+SystemGraph::SystemGraph(const DataFile &file)
+{
+	for(const DataNode &node : file)
+		if(node.Size() >= 2 && node.Token(0) == "system")
+			Add(node);
+	Finish();
+}
+
+
+
+void SystemGraph::Add(const DataNode &node)
+{
+	auto it = index.find(node.Token(1));
+	int i = 0;
+	if(it != index.end())
+		i = it->second;
+	else
+	{
+		i = names.size();
+		index[node.Token(1)] = i;
+		names.push_back(node.Token(1));
+		x.push_back(0.);
+		y.push_back(0.);
+		linkNames.emplace_back();
+	}
+
+	for(const DataNode &child : node)
+	{
+		if(child.Token(0) == "pos" && child.Size() >= 3)
+		{
+			x[i] = child.Value(1);
+			y[i] = child.Value(2);
+		}
+		else if(child.Token(0) == "link" && child.Size() >= 2)
+			linkNames[i].push_back(child.Token(1));
+	}
+}
+
+
+
+void SystemGraph::Finish()
+{
+	// Find each system's own links, skipping any to unknown systems.
+	vector<vector<int>> links(names.size());
+	for(size_t i = 0; i < names.size(); ++i)
+	{
+		for(const string &name : linkNames[i])
+		{
+			int j = Index(name);
+			if(j >= 0 && j != static_cast<int>(i))
+				links[i].push_back(j);
+		}
+		sort(links[i].begin(), links[i].end());
+	}
+
+	// Every link is used in both directions, and only once. The data should
+	// already be like that, so say so if it is not.
+	vector<vector<int>> lists = links;
+	for(size_t i = 0; i < names.size(); ++i)
+		for(auto it = links[i].begin(); it != links[i].end(); ++it)
+		{
+			if(it != links[i].begin() && *it == *prev(it))
+			{
+				cerr << "Warning: " << names[i] << " links to " << names[*it]
+					<< " more than once. Only one link is used." << endl;
+				continue;
+			}
+			if(!binary_search(links[*it].begin(), links[*it].end(), static_cast<int>(i)))
+			{
+				cerr << "Warning: " << names[*it] << " has no link back to " << names[i]
+					<< ". The link is used in both directions." << endl;
+				lists[*it].push_back(i);
+			}
+		}
+
+	offsets.assign(1, 0);
+	targets.clear();
+	for(vector<int> &list : lists)
+	{
+		sort(list.begin(), list.end());
+		list.erase(unique(list.begin(), list.end()), list.end());
+		targets.insert(targets.end(), list.begin(), list.end());
+		offsets.push_back(targets.size());
+	}
+}
+
+
+
+int SystemGraph::Size() const
+{
+	return names.size();
+}
+
+
+
+int SystemGraph::Index(const string &name) const
+{
+	auto it = index.find(name);
+	return (it == index.end()) ? -1 : it->second;
+}
+
+
+
+const string &SystemGraph::Name(int i) const
+{
+	return names[i];
+}
+
+
+
+double SystemGraph::X(int i) const
+{
+	return x[i];
+}
+
+
+
+double SystemGraph::Y(int i) const
+{
+	return y[i];
+}
+
+
+
+SystemGraph::Neighbors SystemGraph::Links(int i) const
+{
+	return Neighbors{targets.data() + offsets[i], targets.data() + offsets[i + 1]};
+}
+
+
+
+int SystemGraph::Degree(int i) const
+{
+	return offsets[i + 1] - offsets[i];
+}
+
+
+
+const vector<int> &SystemGraph::Offsets() const
+{
+	return offsets;
+}
+
+
+
+const vector<int> &SystemGraph::Targets() const
+{
+	return targets;
+}
@@ -0,0 +1,91 @@
+/* SystemGraph.h
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SYSTEM_GRAPH_H_
+#define SYSTEM_GRAPH_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+class DataFile;
+class DataNode;
+
+
+
+// The systems in a map and the hyperspace links between them, stored as a
+// compact graph. Systems are numbered in the order they are first seen, and the
+// neighbors of every system are stored together in one flat array ("compressed
+// sparse row" form), so that algorithms can work with plain integer indices
+// instead of looking up system names. Links are treated as going both ways, and
+// any links to systems that are not part of the map are ignored. That is not
+// how the game treats them, so a warning is printed for any link that only goes
+// one way, or that is given more than once for the same system, since those
+// change the hop distances and neighbor counts that tools see.
+class SystemGraph {
+public:
+	// The neighbors of one system.
+	class Neighbors {
+	public:
+		const int *begin() const;
+		const int *end() const;
+		int Size() const;
+
+	public:
+		const int *first;
+		const int *last;
+	};
+
+
+public:
+	SystemGraph() = default;
+	explicit SystemGraph(const DataFile &file);
+
+	// Add a "system" node. If a system is defined more than once, its links are
+	// combined and the last position given is used.
+	void Add(const DataNode &node);
+	// Build the list of neighbors. This must be done after adding systems and
+	// before asking for any system's neighbors.
+	void Finish();
+
+	int Size() const;
+	// Get the index of the system with the given name, or -1 if there is none.
+	int Index(const std::string &name) const;
+	const std::string &Name(int index) const;
+	double X(int index) const;
+	double Y(int index) const;
+
+	Neighbors Links(int index) const;
+	int Degree(int index) const;
+	// The raw row offsets and neighbor indices, for numerical kernels. The
+	// neighbors of system i are targets[offsets[i]] to targets[offsets[i + 1] - 1].
+	const std::vector<int> &Offsets() const;
+	const std::vector<int> &Targets() const;
+
+
+private:
+	std::vector<std::string> names;
+	std::map<std::string, int> index;
+	std::vector<double> x;
+	std::vector<double> y;
+	std::vector<std::vector<std::string>> linkNames;
+
+	std::vector<int> offsets;
+	std::vector<int> targets;
+};
+
+
+
+#endif
@@ -0,0 +1,119 @@
+/* ThreadPool.cpp
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+using namespace std;
+
+
+
+ThreadPool::ThreadPool(int threads)
+{
+	if(threads <= 0)
+		threads = DefaultSize();
+	for(int i = 0; i < threads; ++i)
+		workers.emplace_back(&ThreadPool::Work, this);
+}
+
+
+
+ThreadPool::~ThreadPool()
+{
+	{
+		lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	hasTask.notify_all();
+	for(thread &worker : workers)
+		worker.join();
+}
+
+
+
+int ThreadPool::Size() const
+{
+	return workers.size();
+}
+
+
+
+void ThreadPool::Add(function<void()> task)
+{
+	{
+		lock_guard<std::mutex> lock(mutex);
+		tasks.push(std::move(task));
+	}
+	hasTask.notify_one();
+}
+
+
+
+void ThreadPool::Wait()
+{
+	unique_lock<std::mutex> lock(mutex);
+	isIdle.wait(lock, [this]() { return tasks.empty() && !busy; });
+}
+
+
+
+void ThreadPool::ForEach(int begin, int end, const function<void(int, int)> &f)
+{
+	int count = end - begin;
+	if(count <= 0)
+		return;
+	int pieces = min(count, Size());
+	for(int i = 0; i < pieces; ++i)
+	{
+		int first = begin + static_cast<long long>(count) * i / pieces;
+		int last = begin + static_cast<long long>(count) * (i + 1) / pieces;
+		Add([&f, first, last]() { f(first, last); });
+	}
+	Wait();
+}
+
+
+
+int ThreadPool::DefaultSize()
+{
+	return max(1u, thread::hardware_concurrency());
+}
+
+
+
+void ThreadPool::Work()
+{
+	while(true)
+	{
+		function<void()> task;
+		{
+			unique_lock<std::mutex> lock(mutex);
+			hasTask.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if(tasks.empty())
+				return;
+			task = std::move(tasks.front());
+			tasks.pop();
+			++busy;
+		}
+		task();
+		{
+			lock_guard<std::mutex> lock(mutex);
+			--busy;
+			if(tasks.empty() && !busy)
+				isIdle.notify_all();
+		}
+	}
+}
@@ -0,0 +1,68 @@
+/* ThreadPool.h
+Copyright (c) 2026 by Endless Sky contributors
+
+Endless Sky is free software: you can redistribute it and/or modify it under the
+terms of the GNU General Public License as published by the Free Software
+Foundation, either version 3 of the License, or (at your option) any later version.
+
+Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along with
+this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+
+
+// A fixed set of worker threads that take tasks from a shared queue. Tasks are
+// started in the order they are added, but may finish in any order.
+class ThreadPool {
+public:
+	// By default, use one thread per core.
+	explicit ThreadPool(int threads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	int Size() const;
+
+	void Add(std::function<void()> task);
+	// Wait until every task that has been added is finished. This must not be
+	// called from within a task, or it will never return.
+	void Wait();
+	// Split the range [begin, end) into about one piece per thread, call
+	// f(first, last) for each piece in parallel, and wait for all of them.
+	void ForEach(int begin, int end, const std::function<void(int, int)> &f);
+
+	static int DefaultSize();
+
+
+private:
+	void Work();
+
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable hasTask;
+	std::condition_variable isIdle;
+	int busy = 0;
+	bool stopping = false;
+};
+
+
+
+#endif
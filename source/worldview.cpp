@@ -14,14 +14,41 @@ this program. If not, see <https://www.gnu.org/licenses/>.
 */
 
 // Program to generate an HTML file with all planets and graphics.
-// $ g++ --std=c++11 -o worldview worldview.cpp
+// $ g++ --std=c++17 -O2 -pthread -o worldview worldview.cpp -lpng -ljpeg -lz
 // $ ./worldview path/to/map.txt > worldview.html
+// Or, to write a separate page for each system, plus an index of them, to the
+// given directory:
+// $ ./worldview [--threads <count>] --output <directory> path/to/map.txt
+// The pages are written in parallel. A hash of everything each page is made
+// from is saved in <directory>/manifest.txt, and the next time, only the pages
+// whose data has changed are written again.
+// To only show part of a large map, give either a rectangle of it, or a system
+// and how many of the systems nearest to it to show as well:
+// $ ./worldview --region <left>,<top>,<right>,<bottom> path/to/map.txt > worldview.html
+// $ ./worldview --near <system> <count> path/to/map.txt > worldview.html
+// The map in the corner of each system is then of just that part of the map.
+// With --thumbnails <images directory>, which needs --output, small copies of
+// the star, planet and landscape images are made in a "thumbnails" directory
+// next to the pages (in parallel, skipping any that are newer than the image
+// they are made from), and the pages show those instead of the full size images.
 
 #include "shared/DataFile.cpp"
 #include "shared/DataNode.cpp"
+#include "shared/Image.cpp"
+#include "shared/Jpeg.cpp"
+#include "shared/SpatialIndex.cpp"
+#include "shared/SvgWriter.cpp"
+#include "shared/ThreadPool.cpp"
 
 #include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <limits>
 #include <map>
@@ -38,6 +65,9 @@ namespace {
 	double maxY = -numeric_limits<double>::infinity();
 
 	map<string, int> uses;
+	// The thumbnail to show for each image, if any, by the name and extension
+	// of the full size image.
+	map<string, string> thumbnails;
 }
 
 class Commodity {
@@ -60,19 +90,35 @@ static const vector<Commodity> commodities = {
 	{"Luxury Goods", 920, 1520}
 };
 
+// One object in a system's diagram: the object it orbits (or -1 for the star),
+// the radius of its orbit in the diagram, and where it is along that orbit.
+class Orbit {
+public:
+	string name;
+	int parent;
+	double radius;
+	double angle;
+};
+
 class System {
 public:
 	void Load(const DataNode &node);
+	// Lay out the system's diagram, once it has been loaded.
+	void Layout();
 
 	const DataNode *root;
-	double x;
-	double y;
+	// Every node that defines this system, for telling whether it has changed.
+	vector<const DataNode *> nodes;
+	double x = 0.;
+	double y = 0.;
 	string government;
 	map<string, double> trade;
 	vector<string> stars;
 	vector<pair<string, string>> planets;
 	vector<string> links;
 	set<string> seenPlanets;
+	// Every object in the system, with each one after the object it orbits.
+	vector<Orbit> orbits;
 };
 
 class Planet {
@@ -84,19 +130,86 @@ public:
 	string spaceport;
 	vector<string> shipyard;
 	vector<string> outfitter;
+	vector<const DataNode *> nodes;
+};
+
+// One system's page of the site: where it is on the map, and what to call it.
+class Page {
+public:
+	const string *name;
+	const System *system;
+	double x;
+	double y;
+	string file;
 };
 
-double MaxDistance(const DataNode &node, double d = 1.);
-void Draw(const DataNode &node, double x, double y, double scale, const string &name);
+void WriteSystem(ostream &out, const string &name, const System &system, const map<string, Planet> &planets,
+	double x, double y);
+int WriteSite(const string &directory, const vector<Page> &pages, const map<string, Planet> &planets,
+	const string &source, int threads);
+uint64_t PageHash(const Page &page, const map<string, Planet> &planets, const string &source);
+uint64_t Hash(uint64_t hash, const void *data, size_t size);
+int Uses(const string &sprite);
+void MakeThumbnails(const string &imagesPath, const string &outputPath, const vector<Page> &pages,
+	const map<string, Planet> &planets, int threads);
+string ImageSource(const string &name, const string &extension);
+void AddOrbits(const DataNode &node, int parent, double distance, vector<Orbit> &orbits, vector<double> &distances);
+void Draw(ostream &out, const vector<Orbit> &orbits, const string &name);
+bool ParseRegion(const char *text, vector<double> &region);
+string FileName(const string &name);
 
 
 
-int main(int argc, char *argv[])
+int main(int, char *argv[])
 {
-	if(argc < 2)
+	string path;
+	string outputPath;
+	string imagesPath;
+	int threads = ThreadPool::DefaultSize();
+	vector<double> region;
+	string nearName;
+	int nearCount = 0;
+	for(char **it = argv + 1; *it; ++it)
+	{
+		if(!strcmp(*it, "--region") && it[1])
+		{
+			if(!ParseRegion(*++it, region))
+			{
+				cerr << "Invalid region: " << *it << endl;
+				return 1;
+			}
+		}
+		else if(!strcmp(*it, "--output") && it[1])
+			outputPath = *++it;
+		else if(!strcmp(*it, "--thumbnails") && it[1])
+			imagesPath = *++it;
+		else if(!strcmp(*it, "--threads") && it[1])
+			threads = max(1, atoi(*++it));
+		else if(!strcmp(*it, "--near") && it[1] && it[2])
+		{
+			nearName = *++it;
+			nearCount = atoi(*++it);
+		}
+		else
+			path = *it;
+	}
+	if(path.empty())
+		return 1;
+	if(!nearName.empty() && nearCount < 1)
+	{
+		cerr << "The number of systems to show near " << nearName << " must be at least 1." << endl;
 		return 1;
+	}
+	// The pages refer to the thumbnails by where they are relative to the
+	// pages, so there must be a directory to write both of them to.
+	if(!imagesPath.empty() && outputPath.empty())
+	{
+		cerr << "Thumbnails can only be made along with --output." << endl;
+		return 1;
+	}
 
-	DataFile file(argv[1]);
+	// Keep the source text of each node, to tell which pages need updating.
+	DataFile file(path, !outputPath.empty());
 
 	map<string, System> systems;
 	map<string, Planet> planets;
@@ -107,11 +220,79 @@ int main(int argc, char *argv[])
 		else if(node.Token(0) == "planet" && node.Size() >= 2)
 			planets[node.Token(1)].Load(node);
 	}
+	for(auto &it : systems)
+		it.second.Layout();
+
+	// Pick out the systems to show, if not all of them, and zoom the map in on
+	// them.
+	bool showAll = true;
+	set<string> shown;
+	if(region.size() == 4 || !nearName.empty())
+	{
+		showAll = false;
+		vector<const string *> names;
+		SpatialIndex index;
+		for(const pair<const string, System> &it : systems)
+		{
+			names.push_back(&it.first);
+			index.Add(it.second.x, it.second.y);
+		}
+		index.Finish();
+
+		vector<int> found;
+		if(region.size() == 4)
+			found = index.InRect(region[0], region[1], region[2], region[3]);
+		else
+		{
+			auto it = systems.find(nearName);
+			if(it == systems.end())
+			{
+				cerr << "No such system: " << nearName << endl;
+				return 1;
+			}
+			found = index.Nearest(it->second.x, it->second.y, nearCount + 1);
+			region = {it->second.x, it->second.y, it->second.x, it->second.y};
+			for(int i : found)
+			{
+				region[0] = min(region[0], index.X(i));
+				region[1] = min(region[1], index.Y(i));
+				region[2] = max(region[2], index.X(i));
+				region[3] = max(region[3], index.Y(i));
+			}
+		}
+		for(int i : found)
+			shown.insert(*names[i]);
+		minX = region[0];
+		minY = region[1];
+		maxX = region[2];
+		maxY = region[3];
+	}
 
 	// Draw all systems:
-	ofstream mapFile("map.svg");
-	mapFile << "<svg width=\"240\" height=\"240\" xmlns=\"http://www.w3.org/2000/svg\" "
-			"xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n";
+	if(!outputPath.empty())
+	{
+		error_code error;
+		filesystem::create_directories(outputPath, error);
+	}
+	// If the systems shown are all in a line or in one place (or there is only
+	// one of them), the map would have no size to scale up from. Give it at
+	// least a minimum width and height, centered on those systems.
+	const double MIN_EXTENT = 100.;
+	if(minX <= maxX && maxX - minX < MIN_EXTENT)
+	{
+		const double pad = (MIN_EXTENT - (maxX - minX)) / 2.;
+		minX -= pad;
+		maxX += pad;
+	}
+	if(minY <= maxY && maxY - minY < MIN_EXTENT)
+	{
+		const double pad = (MIN_EXTENT - (maxY - minY)) / 2.;
+		minY -= pad;
+		maxY += pad;
+	}
+
+	SvgWriter mapFile((filesystem::path(outputPath) / "map.svg").string());
+	mapFile.Begin(240., 240., "xmlns:xlink=\"http://www.w3.org/1999/xlink\"");
 	double radius = 120.;
 	double scale = 2. * (radius - 1.) / max(maxX - minX, maxY - minY);
 	double centerX = (minX + maxX) / 2.;
@@ -134,110 +315,389 @@ int main(int argc, char *argv[])
 
 			double x2 = (lit->second.x - centerX) * scale + radius;
 			double y2 = (lit->second.y - centerY) * scale + radius;
-
-			mapFile << "\n<line x1=\"" << x1 << "\" y1=\"" << y1
-				<< "\" x2=\"" << x2 << "\" y2=\"" << y2
-				<< "\" stroke=\"#333\" stroke-width=\"1.4\"/>";
+			// Skip any links that are entirely outside the map.
+			if(max(x1, x2) < 0. || min(x1, x2) > 2. * radius || max(y1, y2) < 0. || min(y1, y2) > 2. * radius)
+				continue;
+			mapFile.Line(x1, y1, x2, y2, "stroke=\"#333\" stroke-width=\"1.4\"");
 		}
 	}
-	mapFile << "\n</svg>\n";
-	mapFile.close();
+	mapFile.Close();
 
-	cout << "<html><head><title>World Viewer</title>" << endl;
-	cout << "<style>p {margin-top: 0.2em; margin-bottom: 0.2em; line-height: 150%;}</style></head>" << endl;
-	cout << "<body style=\"background-color:black; color:white;\"><table>" << endl;
-	for(const pair<string, System> &it : systems)
+	vector<Page> pages;
+	for(const pair<const string, System> &it : systems)
 	{
-		size_t count = it.second.planets.size();
-		if(!count)
+		if(it.second.planets.empty() || (!showAll && !shown.count(it.first)))
 			continue;
-
-		cout << "<tr><td align=\"center\" valign=\"top\" rowspan=\"" << count
-			<< "\">" << it.first;
-		for(const string &star : it.second.stars)
-			cout << "<br/><img src=\"../images/" << star << ".png\">";
-		cout << "<p>Government: " << it.second.government << "</p>";
-
-		// Draw system location:
+		// Figure out where the system is on the map.
 		double x = (it.second.x - centerX) * scale + radius;
 		double y = (it.second.y - centerY) * scale + radius;
+		pages.push_back({&it.first, &it.second, x, y, FileName(it.first)});
+	}
+	if(!imagesPath.empty())
+		MakeThumbnails(imagesPath, outputPath, pages, planets, threads);
+	if(!outputPath.empty())
+		return WriteSite(outputPath, pages, planets, file.Source(), threads);
+
+	cout << "<html><head><title>World Viewer</title>" << '\n';
+	cout << "<style>p {margin-top: 0.2em; margin-bottom: 0.2em; line-height: 150%;}</style></head>" << '\n';
+	cout << "<body style=\"background-color:black; color:white;\"><table>" << '\n';
+	for(const Page &page : pages)
+		WriteSystem(cout, *page.name, *page.system, planets, page.x, page.y);
+	cout << "</table></body></html>" << '\n';
+}
+
+
+
+// Write the rows of the table for one system: the first row has the system's
+// details and the first planet, and each other planet has a row of its own.
+void WriteSystem(ostream &out, const string &name, const System &system, const map<string, Planet> &planets,
+	double x, double y)
+{
+	size_t count = system.planets.size();
+	out << "<tr><td align=\"center\" valign=\"top\" rowspan=\"" << count
+		<< "\">" << name;
+	for(const string &star : system.stars)
+		out << "<br/><img src=\"" << ImageSource(star, ".png") << "\">";
+	out << "<p>Government: " << system.government << "</p>";
+
+	// Draw system location:
+	out << "<svg width=\"240\" height=\"240\">";
+	out << "<image x=\"0\" y=\"0\" width=\"240\" height=\"240\" xlink:href=\"map.svg\"/>";
+	out << "<circle cx=\"" << x << "\" cy=\"" << y
+		<< "\" r=\"2\" fill=\"#FC3\" stroke=\"none\"/>";
+	out << "</svg><br/>\n";
+
+	out << "<table>";
+	for(const Commodity &commodity : commodities)
+	{
+		auto cit = system.trade.find(commodity.name);
+		if(cit == system.trade.end())
+			continue;
+
+		int price = cit->second;
+		int third = (commodity.high - commodity.low) / 3;
+		string color = (price < commodity.low + third) ? "#6699FF"
+			: (price > commodity.high - third) ? "#FF6666" : "white";
+		out << "<tr style=\"color:" << color << ";\"><td align=\"left\">"
+			<< commodity.name << "</td><td>" << price << "</td></tr>";
+	}
+	out << "</table><p>&nbsp;</p><p>&nbsp;</p><p>&nbsp;</p></td>" << '\n';
+
+	bool first = true;
+	for(const pair<string, string> &planet : system.planets)
+	{
+		if(!first)
+			out << "<tr>";
+		out << "<td valign=\"top\" align=\"center\">" << planet.first;
+		out << "<br/><img src=\"" << ImageSource(planet.second, ".png") << "\">\n";
+
+		static const Planet NONE;
+		auto pit = planets.find(planet.first);
+		const Planet &data = (pit == planets.end()) ? NONE : pit->second;
+		out << "<p style=\"color:#666\">(" << Uses(planet.second) << " / "
+			<< Uses(data.landscape) << " uses.</p>";
+
+		// Draw the star system, with this planet highlighted.
+		out << "<svg width=\"240\" height=\"240\">";
+		Draw(out, system.orbits, planet.first);
+		out << "</svg>\n";
+
+		if(!data.shipyard.empty())
+		{
+			out << "<p>Shipyard:</p>" << '\n';
+			for(const string &name : data.shipyard)
+				out << "<p>" << name << "</p>";
+			out << "<p>&nbsp;</p>";
+		}
+		if(!data.outfitter.empty())
+		{
+			out << "<p>Outfitter:</p>" << '\n';
+			for(const string &name : data.outfitter)
+				out << "<p>" << name << "</p>";
+			out << "<p>&nbsp;</p>";
+		}
+		out << "</td>" << '\n';
+		out << "<td width=\"720\">";
+		if(!data.landscape.empty())
+			out << "<img src=\"" << ImageSource(data.landscape, ".jpg") << "\">";
+		out << data.description << "<hr/>";
+		if(data.spaceport.empty())
+			out << "<p>YOU CANNOT REFUEL HERE.</p>";
+		else
+			out << data.spaceport;
+		out << "<p>&nbsp;</p><p>&nbsp;</p><p>&nbsp;</p>";
+		out << "</td>";
+		if(!first)
+			out << "</tr>";
+		out << '\n';
+
+		first = false;
+	}
+	out << "</tr>" << '\n';
+}
 
-		cout << "<svg width=\"240\" height=\"240\">";
-		cout << "<image x=\"0\" y=\"0\" width=\"240\" height=\"240\" xlink:href=\"map.svg\"/>";
-		cout << "<circle cx=\"" << x << "\" cy=\"" << y
-			<< "\" r=\"2\" fill=\"#FC3\" stroke=\"none\"/>";
-		cout << "</svg><br/>\n";
 
-		cout << "<table>";
-		for(const Commodity &commodity : commodities)
+
+// Write a page for each system, and an index of them, to the given directory.
+// The pages are written in parallel, and any page that would be exactly the
+// same as before is skipped.
+int WriteSite(const string &directory, const vector<Page> &pages, const map<string, Planet> &planets,
+	const string &source, int threads)
+{
+	const filesystem::path root(directory);
+	const string manifestPath = (root / "manifest.txt").string();
+
+	// Read the hash of each page as it was last written.
+	map<string, uint64_t> previous;
+	ifstream in(manifestPath);
+	string text;
+	string file;
+	while(in >> text >> file)
+		previous[file] = strtoull(text.c_str(), nullptr, 16);
+
+	// Make sure no two systems get the same file name.
+	vector<Page> unique = pages;
+	set<string> taken = {"index", "manifest", "map"};
+	for(Page &page : unique)
+	{
+		string file = page.file;
+		for(int i = 2; taken.count(file); ++i)
+			file = page.file + "-" + to_string(i);
+		taken.insert(file);
+		page.file = file + ".html";
+	}
+
+	vector<uint64_t> hashes(unique.size());
+	atomic<int> written(0);
+	atomic<int> failed(0);
+	ThreadPool pool(threads);
+	pool.ForEach(0, unique.size(), [&](int first, int last)
+	{
+		for(int i = first; i < last; ++i)
 		{
-			auto cit = it.second.trade.find(commodity.name);
-			if(cit == it.second.trade.end())
+			const Page &page = unique[i];
+			const string path = (root / page.file).string();
+			hashes[i] = PageHash(page, planets, source);
+			auto it = previous.find(page.file);
+			error_code error;
+			if(it != previous.end() && it->second == hashes[i] && filesystem::exists(path, error))
 				continue;
 
-			int price = cit->second;
-			int third = (commodity.high - commodity.low) / 3;
-			string color = (price < commodity.low + third) ? "#6699FF"
-				: (price > commodity.high - third) ? "#FF6666" : "white";
-			cout << "<tr style=\"color:" << color << ";\"><td align=\"left\">"
-				<< commodity.name << "</td><td>" << price << "</td></tr>";
+			ofstream out(path);
+			out << "<html><head><title>" << *page.name << "</title>" << '\n';
+			out << "<style>p {margin-top: 0.2em; margin-bottom: 0.2em; line-height: 150%;}</style></head>" << '\n';
+			out << "<body style=\"background-color:black; color:white;\">" << '\n';
+			out << "<p><a href=\"index.html\" style=\"color:#6699FF\">All systems</a></p><table>" << '\n';
+			WriteSystem(out, *page.name, *page.system, planets, page.x, page.y);
+			out << "</table></body></html>" << '\n';
+			if(out)
+				++written;
+			else
+			{
+				// Make sure this page is written again next time.
+				cerr << "Unable to write: " << path << endl;
+				hashes[i] = 0;
+				++failed;
+			}
 		}
-		cout << "</table><p>&nbsp;</p><p>&nbsp;</p><p>&nbsp;</p></td>" << endl;
+	});
+
+	ofstream index((root / "index.html").string());
+	index << "<html><head><title>World Viewer</title></head>" << '\n';
+	index << "<body style=\"background-color:black; color:white;\">" << '\n';
+	index << "<img src=\"map.svg\" width=\"240\" height=\"240\"/>" << '\n';
+	for(const Page &page : unique)
+		index << "<p><a href=\"" << page.file << "\" style=\"color:#6699FF\">" << *page.name << "</a> ("
+			<< page.system->government << ")</p>" << '\n';
+	index << "</body></html>" << '\n';
+
+	// Save the new manifest, and remove the pages of any systems that are gone.
+	const string temporary = manifestPath + ".tmp";
+	ofstream manifest(temporary);
+	for(size_t i = 0; i < unique.size(); ++i)
+	{
+		manifest << setw(16) << setfill('0') << hex << hashes[i] << ' ' << unique[i].file << '\n';
+		previous.erase(unique[i].file);
+	}
+	manifest.close();
+	error_code error;
+	filesystem::rename(temporary, manifestPath, error);
+	for(const auto &it : previous)
+		filesystem::remove(root / it.first, error);
+
+	cout << "Wrote " << written << " of " << unique.size() << " pages to " << directory << "." << endl;
+	return (failed || !index || error) ? 1 : 0;
+}
+
+
+
+// Get a hash of everything that goes into a system's page: the text of the
+// nodes that define it and its planets, how many times its planets' images are
+// used, which images have thumbnails, and where it is on the map.
+uint64_t PageHash(const Page &page, const map<string, Planet> &planets, const string &source)
+{
+	// Change this whenever the layout of the pages changes.
+	const uint64_t VERSION = 1;
+	uint64_t hash = Hash(14695981039346656037ull, &VERSION, sizeof(VERSION));
+	hash = Hash(hash, page.name->data(), page.name->size());
+	hash = Hash(hash, &page.x, sizeof(page.x));
+	hash = Hash(hash, &page.y, sizeof(page.y));
+	auto add = [&](const DataNode &node)
+	{
+		size_t begin = node.LineBegin();
+		hash = Hash(hash, source.data() + begin, node.SubtreeEnd() - begin);
+	};
+	auto addImage = [&](const string &name, const string &extension)
+	{
+		string source = ImageSource(name, extension);
+		hash = Hash(hash, source.c_str(), source.size() + 1);
+	};
+	for(const DataNode *node : page.system->nodes)
+		add(*node);
+	for(const string &star : page.system->stars)
+		addImage(star, ".png");
+	for(const pair<string, string> &planet : page.system->planets)
+	{
+		auto it = planets.find(planet.first);
+		if(it != planets.end())
+			for(const DataNode *node : it->second.nodes)
+				add(*node);
+		int uses[2] = {Uses(planet.second), (it != planets.end()) ? Uses(it->second.landscape) : 0};
+		hash = Hash(hash, uses, sizeof(uses));
+		addImage(planet.second, ".png");
+		if(it != planets.end())
+			addImage(it->second.landscape, ".jpg");
+	}
+	return hash;
+}
 
-		bool first = true;
-		for(const pair<string, string> &planet : it.second.planets)
-		{
-			if(!first)
-				cout << "<tr>";
-			cout << "<td valign=\"top\" align=\"center\">" << planet.first;
-			cout << "<br/><img src=\"../images/" << planet.second << ".png\">\n";
 
-			const Planet &data = planets[planet.first];
-			cout << "<p style=\"color:#666\">(" << uses[planet.second] << " / "
-				<< uses[data.landscape] << " uses.</p>";
 
-			// Draw the star system, with this planet highlighted.
-			double distance = MaxDistance(*it.second.root);
-			double scale = min(.03, 116. / distance);
+// Continue a 64-bit FNV-1a hash with the given bytes.
+uint64_t Hash(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *bytes = static_cast<const unsigned char *>(data);
+	for(size_t i = 0; i < size; ++i)
+		hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+
 
-			cout << "<svg width=\"240\" height=\"240\">";
-			Draw(*it.second.root, 120., 120., scale, planet.first);
-			cout << "</svg>\n";
 
-			if(!data.shipyard.empty())
+// Make a thumbnail of every image that is shown on the given pages, on several
+// threads at once. Any thumbnail that is newer than its image is left alone.
+void MakeThumbnails(const string &imagesPath, const string &outputPath, const vector<Page> &pages,
+	const map<string, Planet> &planets, int threads)
+{
+	// The largest size of the thumbnails of sprites (stars and planets), and the
+	// largest width of those of landscapes.
+	const int SPRITE_SIZE = 120;
+	const int LANDSCAPE_WIDTH = 360;
+
+	// Find every image, and whether it is a landscape.
+	set<pair<string, bool>> found;
+	for(const Page &page : pages)
+	{
+		for(const string &star : page.system->stars)
+			found.emplace(star, false);
+		for(const pair<string, string> &planet : page.system->planets)
+		{
+			found.emplace(planet.second, false);
+			auto it = planets.find(planet.first);
+			if(it != planets.end() && !it->second.landscape.empty())
+				found.emplace(it->second.landscape, true);
+		}
+	}
+	found.erase(make_pair(string(), false));
+	const vector<pair<string, bool>> images(found.begin(), found.end());
+
+	const filesystem::path root = filesystem::path(outputPath) / "thumbnails";
+	vector<string> sources(images.size());
+	atomic<int> made(0);
+	ThreadPool pool(threads);
+	pool.ForEach(0, images.size(), [&](int first, int last)
+	{
+		for(int i = first; i < last; ++i)
+		{
+			const string &name = images[i].first;
+			const bool isLandscape = images[i].second;
+
+			// Sprites may be animated, in which case the first frame is used.
+			filesystem::path source;
+			error_code error;
+			static const vector<string> LANDSCAPE = {".jpg", ".png"};
+			static const vector<string> SPRITE = {".png", "+0.png", "-0.png", "~0.png", "=0.png", "^0.png"};
+			for(const string &suffix : isLandscape ? LANDSCAPE : SPRITE)
 			{
-				cout << "<p>Shipyard:</p>" << endl;
-				for(const string &name : data.shipyard)
-					cout << "<p>" << name << "</p>";
-				cout << "<p>&nbsp;</p>";
+				filesystem::path path = filesystem::path(imagesPath) / (name + suffix);
+				if(filesystem::exists(path, error))
+				{
+					source = path;
+					break;
+				}
 			}
-			if(!data.outfitter.empty())
+			if(source.empty())
+				continue;
+
+			const string extension = isLandscape ? ".jpg" : ".png";
+			const filesystem::path target = root / (name + extension);
+			if(!filesystem::exists(target, error)
+				|| filesystem::last_write_time(target, error) < filesystem::last_write_time(source, error))
 			{
-				cout << "<p>Outfitter:</p>" << endl;
-				for(const string &name : data.outfitter)
-					cout << "<p>" << name << "</p>";
-				cout << "<p>&nbsp;</p>";
+				Image image;
+				bool isRead = (source.extension() == ".jpg") ? Jpeg::Read(source.string(), image)
+					: image.Read(source.string());
+				if(!isRead)
+				{
+					cerr << "Unable to read: " << source.string() << endl;
+					continue;
+				}
+
+				double scale = isLandscape ? static_cast<double>(LANDSCAPE_WIDTH) / image.Width()
+					: static_cast<double>(SPRITE_SIZE) / max(image.Width(), image.Height());
+				if(scale < 1.)
+					image = image.Shrink(round(image.Width() * scale), round(image.Height() * scale));
+				filesystem::create_directories(target.parent_path(), error);
+				bool isWritten = isLandscape ? Jpeg::Write(target.string(), image) : image.Write(target.string(), 6);
+				if(!isWritten)
+				{
+					cerr << "Unable to write: " << target.string() << endl;
+					continue;
+				}
+				++made;
 			}
-			cout << "</td>" << endl;
-			cout << "<td width=\"720\">";
-			if(!data.landscape.empty())
-				cout << "<img src=\"../images/" << data.landscape << ".jpg\">";
-			cout << data.description << "<hr/>";
-			if(data.spaceport.empty())
-				cout << "<p>YOU CANNOT REFUEL HERE.</p>";
-			else
-				cout << data.spaceport;
-			cout << "<p>&nbsp;</p><p>&nbsp;</p><p>&nbsp;</p>";
-			cout << "</td>";
-			if(!first)
-				cout << "</tr>";
-			cout << endl;
-
-			first = false;
+			sources[i] = "thumbnails/" + name + extension;
 		}
-		cout << "</tr>" << endl;
-	}
-	cout << "</table></body></html>" << endl;
+	});
+
+	int count = 0;
+	for(size_t i = 0; i < images.size(); ++i)
+		if(!sources[i].empty())
+		{
+			thumbnails[images[i].first + (images[i].second ? ".jpg" : ".png")] = sources[i];
+			++count;
+		}
+	cerr << "Made " << made << " thumbnails; " << (count - made) << " were already up to date, and "
+		<< (images.size() - count) << " images could not be found." << endl;
+}
+
+
+
+// Get the path to show the given image with: its thumbnail if it has one, and
+// otherwise the full size image.
+string ImageSource(const string &name, const string &extension)
+{
+	auto it = thumbnails.find(name + extension);
+	return (it == thumbnails.end()) ? "../images/" + name + extension : it->second;
+}
+
+
+
+// Get how many times the given image is used.
+int Uses(const string &sprite)
+{
+	auto it = uses.find(sprite);
+	return (it == uses.end()) ? 0 : it->second;
 }
 
 
@@ -245,7 +705,10 @@ int main(int argc, char *argv[])
 void System::Load(const DataNode &node)
 {
 	if(node.Token(0) == "system")
+	{
 		root = &node;
+		nodes.push_back(&node);
+	}
 
 	for(const DataNode &child : node)
 	{
@@ -291,8 +754,27 @@ void System::Load(const DataNode &node)
 
 
 
+// Flatten the tree of objects into a list, and scale the orbits to fit the
+// diagram.
+void System::Layout()
+{
+	orbits.clear();
+	vector<double> distances;
+	AddOrbits(*root, -1, 1., orbits, distances);
+
+	double maximum = 1.;
+	for(double distance : distances)
+		maximum = max(maximum, distance);
+	double scale = min(.03, 116. / maximum);
+	for(Orbit &orbit : orbits)
+		orbit.radius = orbit.radius * scale + 1.;
+}
+
+
+
 void Planet::Load(const DataNode &node)
 {
+	nodes.push_back(&node);
 	for(const DataNode &child : node)
 	{
 		if(child.Token(0) == "landscape" && child.Size() >= 2)
@@ -321,60 +803,87 @@ void Planet::Load(const DataNode &node)
 
 
 
-double MaxDistance(const DataNode &node, double d)
+// Add the objects orbiting the given node to the list, along with how far each
+// one is from the star, counting each orbit's distance in full.
+void AddOrbits(const DataNode &node, int parent, double distance, vector<Orbit> &orbits, vector<double> &distances)
 {
-	double maximum = d;
-
 	for(const DataNode &child : node)
 	{
-		if(child.Token(0) == "object")
+		if(child.Token(0) != "object")
+			continue;
+
+		double radius = 0.;
+		double period = 0.;
+		double offset = 0.;
+		for(const DataNode &grand : child)
 		{
-			double thisD = 0.;
-			for(const DataNode &grand : child)
-				if(grand.Token(0) == "distance")
-					thisD = grand.Value(1);
-			thisD = MaxDistance(child, d + thisD);
-			if(thisD > maximum)
-				maximum = thisD;
+			if(grand.Token(0) == "distance")
+				radius = grand.Value(1);
+			else if(grand.Token(0) == "period")
+				period = grand.Value(1);
+			else if(grand.Token(0) == "offset")
+				offset = grand.Value(1);
 		}
+
+		int index = orbits.size();
+		orbits.push_back({child.Size() >= 2 ? child.Token(1) : string(), parent, radius,
+			(offset + 100000. / period) * 0.017453293});
+		distances.push_back(distance + radius);
+		AddOrbits(child, index, distance + radius, orbits, distances);
 	}
-	return maximum;
 }
 
 
 
-void Draw(const DataNode &node, double x, double y, double scale, const string &name)
+// Draw the orbits of a system, with the named object highlighted.
+void Draw(ostream &out, const vector<Orbit> &orbits, const string &name)
 {
-	if(node.Token(0) == "object" && node.Size() >= 2 && node.Token(1) == name)
+	vector<double> x(orbits.size());
+	vector<double> y(orbits.size());
+	for(size_t i = 0; i < orbits.size(); ++i)
 	{
-		cout << "<circle cx=\"" << x << "\" cy=\"" << y
-			<< "\" r=\"2\" fill=\"#39F\" stroke=\"none\"/>";
+		const Orbit &orbit = orbits[i];
+		const double parentX = (orbit.parent < 0) ? 120. : x[orbit.parent];
+		const double parentY = (orbit.parent < 0) ? 120. : y[orbit.parent];
+		out << "<circle cx=\"" << parentX << "\" cy=\"" << parentY << "\" r=\"" << orbit.radius
+			<< "\" stroke=\"#333\" stroke-width=\"1.4\" fill=\"none\"/>";
+
+		x[i] = parentX + orbit.radius * sin(orbit.angle);
+		y[i] = parentY + orbit.radius * cos(orbit.angle);
+		if(orbit.name == name)
+			out << "<circle cx=\"" << x[i] << "\" cy=\"" << y[i]
+				<< "\" r=\"2\" fill=\"#39F\" stroke=\"none\"/>";
 	}
+}
 
-	for(const DataNode &child : node)
-	{
-		if(child.Token(0) == "object")
-		{
-			double distance = 0.;
-			double period = 0.;
-			double offset = 0.;
-			for(const DataNode &grand : child)
-			{
-				if(grand.Token(0) == "distance")
-					distance = grand.Value(1);
-				else if(grand.Token(0) == "period")
-					period = grand.Value(1);
-				else if(grand.Token(0) == "offset")
-					offset = grand.Value(1);
-			}
 
-			distance *= scale;
-			distance += 1.;
-			cout << "<circle cx=\"" << x << "\" cy=\"" << y << "\" r=\"" << distance
-				<< "\" stroke=\"#333\" stroke-width=\"1.4\" fill=\"none\"/>";
 
-			double angle = (offset + 100000. / period) * 0.017453293;
-			Draw(child, x + distance * sin(angle), y + distance * cos(angle), scale, name);
-		}
+// Parse a region given as "left,top,right,bottom".
+bool ParseRegion(const char *text, vector<double> &region)
+{
+	region.clear();
+	while(true)
+	{
+		char *end = nullptr;
+		region.push_back(strtod(text, &end));
+		if(end == text)
+			return false;
+		if(!*end)
+			break;
+		if(*end != ',')
+			return false;
+		text = end + 1;
 	}
+	return region.size() == 4 && region[2] > region[0] && region[3] > region[1];
+}
+
+
+
+// Turn a system name into a file name.
+string FileName(const string &name)
+{
+	string result;
+	for(char c : name)
+		result += isalnum(static_cast<unsigned char>(c)) ? tolower(c) : '-';
+	return result;
 }
@@ -0,0 +1,76 @@
+#!/usr/bin/python
+# generate_map.py
+# Copyright (c) 2026 by Endless Sky contributors
+#
+# Endless Sky is free software: you can redistribute it and/or modify it under the
+# terms of the GNU General Public License as published by the Free Software
+# Foundation, either version 3 of the License, or (at your option) any later version.
+#
+# Endless Sky is distributed in the hope that it will be useful, but WITHOUT ANY
+# WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+# PARTICULAR PURPOSE. See the GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License along with
+# this program. If not, see <https://www.gnu.org/licenses/>.
+
+import math
+import random
+import sys
+
+# Script that writes a random map with any number of systems, for timing the tools on maps much bigger than
+# the real one. Each system is linked to its three nearest neighbors, and every hundredth system is a "hub" that
+# is also linked to every system within a few cells of the grid below, so that some parts of the map have many
+# more links than others. Every link goes both ways.
+# $ python3 utils/generate_map.py <systems> [seed] > map.txt
+
+NEAREST = 3
+HUB_SPACING = 100
+HUB_REACH = 3
+
+if len(sys.argv) < 2:
+	print("Usage: generate_map.py <systems> [seed]", file=sys.stderr)
+	sys.exit(1)
+count = int(sys.argv[1])
+random.seed(int(sys.argv[2]) if len(sys.argv) > 2 else 1)
+
+# Keep the density of systems about the same as in the real map.
+size = 40. * math.sqrt(count)
+positions = [(random.uniform(-size, size), random.uniform(-size, size)) for i in range(count)]
+
+# Sort the systems into a grid of cells about one system wide, so that the neighbors of each one can be found
+# without comparing it to every other system.
+cell = 2. * size / math.sqrt(count)
+grid = {}
+for i, (x, y) in enumerate(positions):
+	grid.setdefault((int(x // cell), int(y // cell)), []).append(i)
+
+
+def nearby(i, reach):
+	x, y = positions[i]
+	cx, cy = int(x // cell), int(y // cell)
+	for gx in range(cx - reach, cx + reach + 1):
+		for gy in range(cy - reach, cy + reach + 1):
+			for j in grid.get((gx, gy), []):
+				if j != i:
+					yield (positions[j][0] - x) ** 2 + (positions[j][1] - y) ** 2, j
+
+
+links = [set() for i in range(count)]
+for i in range(count):
+	reach = 1
+	candidates = sorted(nearby(i, reach))
+	while len(candidates) < NEAREST and reach * reach < count:
+		reach += 1
+		candidates = sorted(nearby(i, reach))
+	chosen = candidates[:NEAREST]
+	if i % HUB_SPACING == 0:
+		chosen += list(nearby(i, HUB_REACH))
+	for distance, j in chosen:
+		links[i].add(j)
+		links[j].add(i)
+
+for i in range(count):
+	print('system "Random %d"' % i)
+	print('\tpos %.2f %.2f' % positions[i])
+	for j in sorted(links[i]):
+		print('\tlink "Random %d"' % j)